@@ -0,0 +1,792 @@
+// замеры производительности стола: make bench
+// результаты в CSV (по умолчанию) или JSON, чтобы сравнивать сборки между собой
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <climits>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stop_token>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "smoking_types.hpp"
+#include "smoking_table.hpp"
+#include "smoking_atomic_table.hpp"
+#include "smoking_coro.hpp"
+#include "smoking_cluster.hpp"
+#include "smoking_padding.hpp"
+#include "smoking_shm_table.hpp"
+#include "smoking_inventory.hpp"
+#include "smoking_pool.hpp"
+
+namespace baseline {
+
+// прежняя версия стола: place() будит всех курильщиков через один общий smoker_cv_
+// оставлена здесь только как точка отсчета для сравнения
+class BroadcastSmokingTable {
+ public:
+  void place(Ingredient first, Ingredient second) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    table_cv_.wait(lock, [this] {
+      return finished_ || (!items_.has_value() && !smoker_busy_);
+    });
+    if (finished_) {
+      return;
+    }
+    items_.emplace(std::array<Ingredient, 2>{first, second});
+    smoker_cv_.notify_all();
+  }
+
+  bool startSmoking(Ingredient owned) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    smoker_cv_.wait(lock, [this, owned] {
+      return finished_ || (items_.has_value() && (*items_)[0] != owned &&
+                           (*items_)[1] != owned);
+    });
+    if (finished_) {
+      return false;
+    }
+    smoker_busy_ = true;
+    items_.reset();
+    lock.unlock();
+    table_cv_.notify_all();
+    return true;
+  }
+
+  void finishSmoking() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    smoker_busy_ = false;
+    table_cv_.notify_all();
+  }
+
+  void waitForRoundEnd() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    table_cv_.wait(lock, [this] {
+      return finished_ || (!items_.has_value() && !smoker_busy_);
+    });
+  }
+
+  void finish() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    finished_ = true;
+    items_.reset();
+    smoker_busy_ = false;
+    table_cv_.notify_all();
+    smoker_cv_.notify_all();
+  }
+
+ private:
+  std::mutex mutex_{};
+  std::condition_variable table_cv_{};
+  std::condition_variable smoker_cv_{};
+  std::optional<std::array<Ingredient, 2>> items_{};
+  bool smoker_busy_{false};
+  bool finished_{false};
+};
+
+} // namespace baseline
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// одна строка отчета
+struct BenchResult {
+  std::string table;
+  std::string benchmark;
+  std::size_t smokers{}; // всего курильщиков за столом
+  std::size_t depth{}; // глубина конвейера
+  long work_us{}; // сколько курильщик "курит" в каждом раунде, мкс
+  int rounds{};
+  double rounds_per_sec{};
+  // задержка place() -> startSmoking(), мкс; меряется только когда посредник ждет каждый раунд
+  bool has_latency{false};
+  double p50_us{};
+  double p90_us{};
+  double p99_us{};
+  double p999_us{};
+  long context_switches{}; // добровольные + принудительные переключения контекста за прогон
+  // промахи L1d по чтению за прогон (аппаратный счетчик, только false_sharing); -1 - не меряли или perf недоступен
+  long long l1d_misses{-1};
+};
+
+struct RunOptions {
+  std::size_t smokers_per_type{1};
+  std::size_t depth{1};
+  int rounds{0};
+  bool wait_each_round{true}; // false - посредник кладет раунды подряд и ждет один раз в конце
+  std::chrono::microseconds work{0}; // время раунда; курильщик крутится, а не спит, чтобы не мерить sleep_for
+  bool fused{false}; // посредник зовет runRound() вместо place() + waitForRoundEnd()
+};
+
+long ContextSwitches() {
+  rusage usage{};
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_nvcsw + usage.ru_nivcsw;
+}
+
+// аппаратный счетчик промахов L1d по чтению: этот поток и все потоки, которые он запустит после start()
+// (inherit: счет завершившихся потоков добавляется к нашему, поэтому читать - после join())
+// строка, которую соседнее ядро забрало себе на запись, - это промах L1d, так что ложное разделение видно прямо тут
+// perf_event_open бывает недоступен (контейнер, perf_event_paranoid, нет PMU) - тогда stop() вернет -1
+class L1dMissCounter {
+ public:
+  L1dMissCounter() {
+    perf_event_attr attr{};
+    attr.type = PERF_TYPE_HW_CACHE;
+    attr.size = sizeof(attr);
+    attr.config = PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                  (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    attr.disabled = 1;
+    attr.inherit = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    fd_ = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+  }
+
+  L1dMissCounter(const L1dMissCounter&) = delete;
+  L1dMissCounter& operator=(const L1dMissCounter&) = delete;
+
+  ~L1dMissCounter() {
+    if (fd_ >= 0) {
+      close(fd_);
+    }
+  }
+
+  void start() {
+    if (fd_ >= 0) {
+      ioctl(fd_, PERF_EVENT_IOC_RESET, 0);
+      ioctl(fd_, PERF_EVENT_IOC_ENABLE, 0);
+    }
+  }
+
+  long long stop() {
+    if (fd_ < 0) {
+      return -1;
+    }
+    ioctl(fd_, PERF_EVENT_IOC_DISABLE, 0);
+    long long misses = 0;
+    return read(fd_, &misses, sizeof(misses)) == static_cast<ssize_t>(sizeof(misses)) ? misses : -1;
+  }
+
+ private:
+  int fd_{-1};
+};
+
+double Percentile(const std::vector<double>& sorted, double fraction) {
+  if (sorted.empty()) {
+    return 0.0;
+  }
+  const auto index = static_cast<std::size_t>(fraction * static_cast<double>(sorted.size() - 1));
+  return sorted[index];
+}
+
+// options.rounds раундов с нулевым временем курения: курильщик забирает пару и сразу докуривает
+// make_table() создает стол нужной реализации и глубины
+template <typename MakeTable>
+BenchResult Run(std::string table_name, std::string benchmark, MakeTable make_table,
+                const RunOptions& options) {
+  auto table = make_table();
+  const bool measure_latency = options.wait_each_round;
+  std::atomic<Clock::rep> placed_at{0};
+  std::atomic<int> current_round{0};
+  std::vector<double> latencies(measure_latency ? static_cast<std::size_t>(options.rounds) : 0);
+
+  auto smoker_task = [&](Ingredient ingredient) {
+    while (table->startSmoking(ingredient)) {
+      if (measure_latency) { // в этом режиме в полете ровно один раунд, пишет только его курильщик
+        const auto now = Clock::now().time_since_epoch().count();
+        latencies[static_cast<std::size_t>(current_round.load())] =
+            static_cast<double>(now - placed_at.load()) / 1000.0;
+      }
+      if (options.work.count() > 0) {
+        const auto until = Clock::now() + options.work;
+        while (Clock::now() < until) {
+        }
+      }
+      table->finishSmoking();
+    }
+  };
+
+  std::vector<std::thread> smokers;
+  for (std::size_t i = 0; i < kSmokerCount * options.smokers_per_type; ++i) {
+    smokers.emplace_back(smoker_task, kAllSmokers[i % kSmokerCount]);
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(10)); // даем курильщикам заснуть на столе
+
+  const long switches_before = ContextSwitches();
+  const auto start = Clock::now();
+  for (int round = 0; round < options.rounds; ++round) {
+    const auto components =
+        ComponentsFor(kAllSmokers[static_cast<std::size_t>(round) % kSmokerCount]);
+    if (measure_latency) {
+      current_round.store(round);
+      placed_at.store(Clock::now().time_since_epoch().count());
+    }
+    if constexpr (requires { table->runRound(components[0], components[1]); }) {
+      if (options.fused) {
+        table->runRound(components[0], components[1]);
+        continue;
+      }
+    }
+    table->place(components[0], components[1]);
+    if (options.wait_each_round) {
+      table->waitForRoundEnd();
+    }
+  }
+  table->waitForRoundEnd();
+  const auto elapsed = Clock::now() - start;
+  const long switches_after = ContextSwitches();
+
+  table->finish();
+  for (auto& smoker : smokers) {
+    smoker.join();
+  }
+
+  BenchResult result;
+  result.table = std::move(table_name);
+  result.benchmark = std::move(benchmark);
+  result.smokers = smokers.size();
+  result.depth = options.depth;
+  result.work_us = static_cast<long>(options.work.count());
+  result.rounds = options.rounds;
+  result.rounds_per_sec = options.rounds / std::chrono::duration<double>(elapsed).count();
+  std::sort(latencies.begin(), latencies.end());
+  result.has_latency = measure_latency;
+  result.p50_us = Percentile(latencies, 0.50);
+  result.p90_us = Percentile(latencies, 0.90);
+  result.p99_us = Percentile(latencies, 0.99);
+  result.p999_us = Percentile(latencies, 0.999);
+  result.context_switches = switches_after - switches_before;
+  return result;
+}
+
+auto MakeBroadcast(std::size_t) {
+  return [] { return std::make_unique<baseline::BroadcastSmokingTable>(); };
+}
+
+auto MakeMutex(std::size_t depth) {
+  return [depth] { return std::make_unique<SmokingTable>(depth); };
+}
+
+// стол в общей памяти под именем этого процесса; не вышло (например, сегмент с таким именем
+// остался от чужого запуска) - бенчмарк дальше не идет
+SharedSmokingTable CreateSharedOrExit() {
+  const std::string name = "/smoking_bench_" + std::to_string(getpid());
+  auto table = SharedSmokingTable::Create(name);
+  if (!table) {
+    std::fprintf(stderr, "cannot create shared table %s: %s\n", name.c_str(), std::strerror(errno));
+    std::exit(1);
+  }
+  return std::move(*table);
+}
+
+// стол в общей памяти, но курильщики - потоки этого же процесса: цена futex без FUTEX_PRIVATE_FLAG
+auto MakeShared(std::size_t) {
+  return [] { return std::make_unique<SharedSmokingTable>(CreateSharedOrExit()); };
+}
+
+template <typename Table>
+auto MakeWithPolicy(std::size_t depth) {
+  return [depth] { return std::make_unique<Table>(depth); };
+}
+
+auto MakeAtomic(std::size_t) {
+  return [] { return std::make_unique<AtomicSmokingTable>(); };
+}
+
+CoroExecutor::Task CoroSmoker(AsyncSmokingTable& table, Ingredient ingredient) {
+  while (true) { // co_await прямо в условии while g++ 12 собирает неверно
+    const bool took = co_await table.startSmoking(ingredient);
+    if (!took) {
+      break;
+    }
+    table.finishSmoking();
+  }
+}
+
+CoroExecutor::Task CoroAgent(AsyncSmokingTable& table, int rounds) {
+  for (int round = 0; round < rounds; ++round) {
+    const auto components =
+        ComponentsFor(kAllSmokers[static_cast<std::size_t>(round) % kSmokerCount]);
+    co_await table.place(components[0], components[1]);
+    co_await table.waitForRoundEnd();
+  }
+  table.finish();
+}
+
+// много столов на корутинах: у каждого свой посредник и три курильщика, все на одном исполнителе
+// посредник ждет каждый раунд, так что это тот же handoff, но на tables столах сразу
+BenchResult RunCoroutines(std::size_t tables, int rounds_per_table) {
+  CoroExecutor executor;
+  std::vector<std::unique_ptr<AsyncSmokingTable>> boards;
+  for (std::size_t i = 0; i < tables; ++i) {
+    boards.push_back(std::make_unique<AsyncSmokingTable>(executor));
+  }
+
+  const long switches_before = ContextSwitches();
+  const auto start = Clock::now();
+  for (auto& board : boards) {
+    for (const Ingredient ingredient : kAllSmokers) {
+      executor.spawn(CoroSmoker(*board, ingredient));
+    }
+    executor.spawn(CoroAgent(*board, rounds_per_table));
+  }
+  executor.waitIdle();
+  const auto elapsed = Clock::now() - start;
+  const long switches_after = ContextSwitches();
+
+  BenchResult result;
+  result.table = "coroutine";
+  result.benchmark = "many_tables";
+  result.smokers = tables * kSmokerCount;
+  result.depth = 1;
+  result.rounds = rounds_per_table * static_cast<int>(tables);
+  result.rounds_per_sec = result.rounds / std::chrono::duration<double>(elapsed).count();
+  result.context_switches = switches_after - switches_before;
+  return result;
+}
+
+// стол в общей памяти, курильщики - отдельные процессы; посредник ждет каждый раунд
+BenchResult RunSharedProcesses(int rounds) {
+  auto table = std::make_unique<SharedSmokingTable>(CreateSharedOrExit());
+  std::vector<pid_t> children;
+  for (const Ingredient ingredient : kAllSmokers) {
+    const pid_t child = fork();
+    if (child == 0) {
+      while (table->startSmoking(ingredient)) {
+        table->finishSmoking();
+      }
+      _exit(0);
+    }
+    children.push_back(child);
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+  const auto start = Clock::now();
+  for (int round = 0; round < rounds; ++round) {
+    const auto components = ComponentsFor(kAllSmokers[static_cast<std::size_t>(round) % kSmokerCount]);
+    table->runRound(components[0], components[1]);
+  }
+  const auto elapsed = Clock::now() - start;
+  table->finish();
+  long context_switches = 0;
+  for (const pid_t child : children) {
+    int status = 0;
+    rusage usage{};
+    wait4(child, &status, 0, &usage); // переключения считаем и у детей
+    context_switches += usage.ru_nvcsw + usage.ru_nivcsw;
+  }
+
+  BenchResult result;
+  result.table = "shm_processes";
+  result.benchmark = "handoff";
+  result.smokers = kSmokerCount;
+  result.depth = 1;
+  result.rounds = rounds;
+  result.rounds_per_sec = rounds / std::chrono::duration<double>(elapsed).count();
+  result.context_switches = context_switches;
+  return result;
+}
+
+// задержка остановки: от request_stop() (или finish()) до того, как ждущий курильщик вышел из startSmoking()
+// по stop_token отменяется каждый курильщик отдельно, finish() закрывает весь стол
+BenchResult RunShutdown(std::string table_name, bool use_stop_token, int iterations) {
+  std::vector<double> latencies;
+  latencies.reserve(static_cast<std::size_t>(iterations) * kSmokerCount);
+  const long switches_before = ContextSwitches();
+  const auto start = Clock::now();
+  for (int iteration = 0; iteration < iterations; ++iteration) {
+    SmokingTable table;
+    std::array<std::stop_source, kSmokerCount> stops{};
+    std::array<Clock::time_point, kSmokerCount> exited{};
+    std::vector<std::thread> smokers;
+    for (std::size_t i = 0; i < kSmokerCount; ++i) {
+      smokers.emplace_back([&, i] {
+        const Ingredient ingredient = kAllSmokers[i];
+        if (use_stop_token) {
+          table.startSmoking(ingredient, stops[i].get_token());
+        } else {
+          table.startSmoking(ingredient);
+        }
+        exited[i] = Clock::now();
+      });
+    }
+    for (const Ingredient ingredient : kAllSmokers) { // все трое должны реально ждать на столе
+      while (table.idleSmokers(ingredient) == 0) {
+        std::this_thread::yield();
+      }
+    }
+    const auto stop_at = Clock::now();
+    if (use_stop_token) {
+      for (auto& stop : stops) {
+        stop.request_stop();
+      }
+    } else {
+      table.finish();
+    }
+    for (auto& smoker : smokers) {
+      smoker.join();
+    }
+    for (const auto at : exited) {
+      latencies.push_back(std::chrono::duration<double, std::micro>(at - stop_at).count());
+    }
+  }
+  const auto elapsed = Clock::now() - start;
+  const long switches_after = ContextSwitches();
+
+  std::sort(latencies.begin(), latencies.end());
+  BenchResult result;
+  result.table = std::move(table_name);
+  result.benchmark = "shutdown";
+  result.smokers = kSmokerCount;
+  result.depth = 1;
+  result.rounds = iterations;
+  result.rounds_per_sec = iterations / std::chrono::duration<double>(elapsed).count();
+  result.has_latency = true;
+  result.p50_us = Percentile(latencies, 0.50);
+  result.p90_us = Percentile(latencies, 0.90);
+  result.p99_us = Percentile(latencies, 0.99);
+  result.p999_us = Percentile(latencies, 0.999);
+  result.context_switches = switches_after - switches_before;
+  return result;
+}
+
+// столько же раундов на каждый стол кластера: при почти линейном масштабировании
+// раунды/сек растут вместе с числом столов и ядер
+BenchResult RunCluster(std::size_t tables, int rounds_per_table) {
+  ClusterConfig config;
+  config.tables = tables;
+  config.rounds_per_table = static_cast<std::uint64_t>(rounds_per_table);
+  TableCluster cluster(config);
+
+  const long switches_before = ContextSwitches();
+  const ClusterStats stats = cluster.run();
+  const long switches_after = ContextSwitches();
+
+  BenchResult result;
+  result.table = "cluster";
+  result.benchmark = "cluster_scaling";
+  result.smokers = tables * kSmokerCount;
+  result.depth = config.depth;
+  result.rounds = static_cast<int>(stats.rounds);
+  result.rounds_per_sec = stats.roundsPerSecond();
+  result.context_switches = switches_after - switches_before;
+  return result;
+}
+
+// счетчики курильщиков в плотном массиве и каждый в своей строке кэша
+// kSmokerCount потоков крутят ++ по своему счетчику, как smoked_count в main на высокой частоте раундов
+// в плотном массиве строка кэша ходит между ядрами на каждой записи, с разнесенными - нет
+// rounds_per_sec здесь - пропускная способность (++ в секунду), а саму переброску строк показывает l1d_misses
+template <typename Counters>
+BenchResult RunCounters(std::string table_name, int increments) {
+  Counters counters{};
+  L1dMissCounter misses;
+  const long switches_before = ContextSwitches();
+  misses.start();
+  const auto start = Clock::now();
+  std::vector<std::thread> threads;
+  for (std::size_t i = 0; i < kSmokerCount; ++i) {
+    threads.emplace_back([&counters, i, increments] {
+      for (int n = 0; n < increments; ++n) {
+        counters[i].fetch_add(1, std::memory_order_relaxed);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  const auto elapsed = Clock::now() - start;
+  const long long l1d_misses = misses.stop();
+  const long switches_after = ContextSwitches();
+
+  std::uint64_t total = 0;
+  for (std::size_t i = 0; i < kSmokerCount; ++i) {
+    total += counters[i].load(std::memory_order_relaxed);
+  }
+
+  BenchResult result;
+  result.table = std::move(table_name);
+  result.benchmark = "false_sharing";
+  result.smokers = kSmokerCount;
+  result.depth = 1;
+  result.rounds = static_cast<int>(total);
+  result.rounds_per_sec = static_cast<double>(total) / std::chrono::duration<double>(elapsed).count();
+  result.context_switches = switches_after - switches_before;
+  result.l1d_misses = l1d_misses;
+  return result;
+}
+
+// склад с поставщиками: по потоку на компонент, каждый кладет единицы, пока стол не закроют,
+// курильщики разбирают пары; посредника нет, поэтому раунды не упираются в один поток, выкладывающий пары
+// поставщиков не ограничиваем числом единиц: при конечном запасе склад может застрять, когда остался
+// только один компонент, а его поставщик ждет места
+BenchResult RunInventory(std::size_t smokers_per_type, int rounds) {
+  InventoryTable table;
+  const auto target = static_cast<std::uint64_t>(rounds);
+  const long switches_before = ContextSwitches();
+  const auto start = Clock::now();
+  std::vector<std::thread> smokers;
+  for (std::size_t i = 0; i < kSmokerCount * smokers_per_type; ++i) {
+    smokers.emplace_back([&table, target, smoker = kAllSmokers[i % kSmokerCount]] {
+      while (table.startSmoking(smoker)) {
+        table.finishSmoking();
+        if (table.completedRounds() >= target) {
+          table.finish();
+        }
+      }
+    });
+  }
+  std::vector<std::thread> producers;
+  for (const Ingredient ingredient : kAllSmokers) {
+    producers.emplace_back([&table, ingredient] {
+      while (table.supply(ingredient)) {
+      }
+    });
+  }
+  for (auto& producer : producers) {
+    producer.join();
+  }
+  for (auto& smoker : smokers) {
+    smoker.join();
+  }
+  const auto elapsed = Clock::now() - start;
+  const long switches_after = ContextSwitches();
+
+  BenchResult result;
+  result.table = "inventory";
+  result.benchmark = "producers";
+  result.smokers = kSmokerCount * smokers_per_type;
+  result.depth = 1;
+  result.rounds = static_cast<int>(table.completedRounds());
+  result.rounds_per_sec =
+      static_cast<double>(result.rounds) / std::chrono::duration<double>(elapsed).count();
+  result.context_switches = switches_after - switches_before;
+  return result;
+}
+
+// то же, что Run() с wait_each_round = false, но курильщики - задачи пула, а не потоки:
+// работа раунда крутится на ядрах пула, столько раундов одновременно, сколько в пуле потоков
+BenchResult RunPooled(std::size_t depth, int rounds, std::chrono::microseconds work) {
+  SmokingTable table(depth);
+  WorkStealingPool pool;
+  std::optional<PooledSmokers<SmokingTable>> smokers;
+  smokers.emplace(table, pool, depth / kSmokerCount, [work](const PooledSmokers<SmokingTable>::Round& round) {
+    const auto until = Clock::now() + work;
+    while (Clock::now() < until) { // работа - счет на ядре, ее пул и делит
+    }
+    round.done();
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(10)); // даем диспетчерам заснуть на столе
+
+  const long switches_before = ContextSwitches();
+  const auto start = Clock::now();
+  for (int round = 0; round < rounds; ++round) {
+    const auto components = ComponentsFor(kAllSmokers[static_cast<std::size_t>(round) % kSmokerCount]);
+    table.place(components[0], components[1]);
+  }
+  table.waitForRoundEnd();
+  const auto elapsed = Clock::now() - start;
+  const long switches_after = ContextSwitches();
+  table.finish();
+  smokers.reset();
+
+  BenchResult result;
+  result.table = "mutex_pool";
+  result.benchmark = "task_pool";
+  result.smokers = pool.size(); // одновременно курят не больше, чем потоков в пуле
+  result.depth = depth;
+  result.work_us = static_cast<long>(work.count());
+  result.rounds = rounds;
+  result.rounds_per_sec = rounds / std::chrono::duration<double>(elapsed).count();
+  result.context_switches = switches_after - switches_before;
+  return result;
+}
+
+void PrintCsv(const std::vector<BenchResult>& results) {
+  std::printf("table,benchmark,smokers,depth,work_us,rounds,rounds_per_sec,p50_us,p90_us,p99_us,p999_us,context_switches,l1d_misses\n");
+  for (const auto& r : results) {
+    std::printf("%s,%s,%zu,%zu,%ld,%d,%.0f,", r.table.c_str(), r.benchmark.c_str(), r.smokers,
+                r.depth, r.work_us, r.rounds, r.rounds_per_sec);
+    if (r.has_latency) {
+      std::printf("%.2f,%.2f,%.2f,%.2f,", r.p50_us, r.p90_us, r.p99_us, r.p999_us);
+    } else {
+      std::printf(",,,,"); // задержку в этом режиме не меряем
+    }
+    std::printf("%ld,", r.context_switches);
+    if (r.l1d_misses >= 0) {
+      std::printf("%lld\n", r.l1d_misses);
+    } else {
+      std::printf("\n"); // не меряли или perf_event_open недоступен
+    }
+  }
+}
+
+void PrintJson(const std::vector<BenchResult>& results) {
+  std::printf("[\n");
+  for (std::size_t i = 0; i < results.size(); ++i) {
+    const auto& r = results[i];
+    std::printf("  {\"table\": \"%s\", \"benchmark\": \"%s\", \"smokers\": %zu, \"depth\": %zu, "
+                "\"work_us\": %ld, \"rounds\": %d, \"rounds_per_sec\": %.0f, ",
+                r.table.c_str(), r.benchmark.c_str(), r.smokers, r.depth, r.work_us, r.rounds,
+                r.rounds_per_sec);
+    if (r.has_latency) {
+      std::printf("\"p50_us\": %.2f, \"p90_us\": %.2f, \"p99_us\": %.2f, \"p999_us\": %.2f, ",
+                  r.p50_us, r.p90_us, r.p99_us, r.p999_us);
+    } else {
+      std::printf("\"p50_us\": null, \"p90_us\": null, \"p99_us\": null, \"p999_us\": null, ");
+    }
+    std::printf("\"context_switches\": %ld, ", r.context_switches);
+    if (r.l1d_misses >= 0) {
+      std::printf("\"l1d_misses\": %lld}", r.l1d_misses);
+    } else {
+      std::printf("\"l1d_misses\": null}");
+    }
+    std::printf("%s\n", i + 1 < results.size() ? "," : "");
+  }
+  std::printf("]\n");
+}
+
+// --rounds=N: целое от 1; сверху - чтобы rounds * 500 итераций false_sharing не переполнили int
+std::optional<int> ParseRounds(std::string_view text) {
+  int value = 0;
+  const auto result = std::from_chars(text.data(), text.data() + text.size(), value);
+  if (result.ec != std::errc{} || result.ptr != text.data() + text.size() || value < 1 || value > INT_MAX / 500) {
+    return std::nullopt;
+  }
+  return value;
+}
+
+} // namespace
+
+// ./bench [--format=csv|json] [--rounds=N]   (N - целое от 1, по умолчанию 20000)
+// handoff  - посредник ждет каждый раунд: задержка place() -> startSmoking() и раунды/сек
+//            (mutex_run_round - то же через runRound(), один захват мьютекса на раунд;
+//             shm_threads/shm_processes - стол в общей памяти с курильщиками-потоками и курильщиками-процессами)
+// pipeline - посредник кладет раунды подряд, стол с конвейером разной глубины
+// scaling  - растет число курильщиков каждого типа
+// wait_policy - стол с ожиданием блокирующим, спин-затем-сон и yield при разной длине раунда
+// shutdown - задержка от request_stop()/finish() до выхода ждущего курильщика; rounds - число остановок
+// false_sharing - счетчики курильщиков вплотную и по строкам кэша: rounds_per_sec - это ++ в секунду,
+//                 переброску строк между ядрами считает l1d_misses (perf_event_open; пусто, если он недоступен)
+// producers - склад (inventory) с поставщиками вместо посредника, 1 и 2 курильщика на тип
+// task_pool - 24 раунда в полете по 100 мкс: поток на курильщика (mutex_threads) против пула по ядрам (mutex_pool)
+// cluster_scaling - по столу кластера на ядро, 1, 2, 4... стола до числа доступных ядер
+// many_tables - сотни и тысячи столов на корутинах, по потоку исполнителя на ядро
+int main(int argc, char** argv) {
+  bool json = false;
+  int rounds = 20000;
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    if (arg == "--format=json") {
+      json = true;
+    } else if (arg == "--format=csv") {
+      json = false;
+    } else if (arg.rfind("--rounds=", 0) == 0) {
+      const auto parsed = ParseRounds(std::string_view(arg).substr(std::string_view("--rounds=").size()));
+      if (!parsed) {
+        std::fprintf(stderr, "--rounds: нужно целое от 1 до %d, а не %s\n", INT_MAX / 500, arg.c_str());
+        return 1;
+      }
+      rounds = *parsed;
+    } else {
+      std::fprintf(stderr, "usage: %s [--format=csv|json] [--rounds=N]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  std::vector<BenchResult> results;
+  const RunOptions handoff{1, 1, rounds, true};
+  results.push_back(Run("broadcast", "handoff", MakeBroadcast(1), handoff));
+  results.push_back(Run("mutex", "handoff", MakeMutex(1), handoff));
+  results.push_back(Run("atomic", "handoff", MakeAtomic(1), handoff));
+  RunOptions fused = handoff;
+  fused.fused = true;
+  results.push_back(Run("mutex_run_round", "handoff", MakeMutex(1), fused));
+  results.push_back(Run("shm_threads", "handoff", MakeShared(1), handoff));
+  results.push_back(RunSharedProcesses(rounds));
+
+  for (const std::size_t depth : {2, 4, 8}) {
+    results.push_back(Run("mutex", "pipeline", MakeMutex(depth),
+                          RunOptions{1, depth, rounds, false}));
+  }
+
+  for (const std::size_t per_type : {1, 2, 4, 8}) {
+    const RunOptions serial{per_type, 1, rounds, true};
+    results.push_back(Run("broadcast", "scaling", MakeBroadcast(1), serial));
+    results.push_back(Run("mutex", "scaling", MakeMutex(1), serial));
+    results.push_back(Run("atomic", "scaling", MakeAtomic(1), serial));
+    const std::size_t depth = per_type * kSmokerCount;
+    results.push_back(Run("mutex", "scaling", MakeMutex(depth),
+                          RunOptions{per_type, depth, rounds, false}));
+  }
+
+  for (const long work_us : {0L, 10L, 100L, 1000L}) {
+    // длинные раунды - меньше раундов, чтобы прогон не растягивался
+    const int policy_rounds = work_us >= 1000 ? std::max(1, rounds / 20) : rounds;
+    const RunOptions options{1, 1, policy_rounds, true, std::chrono::microseconds(work_us)};
+    results.push_back(Run("mutex_blocking", "wait_policy", MakeWithPolicy<SmokingTable>(1), options));
+    results.push_back(Run("mutex_spin", "wait_policy", MakeWithPolicy<SpinningSmokingTable>(1), options));
+    results.push_back(Run("mutex_yield", "wait_policy", MakeWithPolicy<YieldingSmokingTable>(1), options));
+  }
+
+  const int shutdowns = std::max(1, rounds / 20);
+  results.push_back(RunShutdown("mutex_stop_token", true, shutdowns));
+  results.push_back(RunShutdown("mutex_finish", false, shutdowns));
+
+  results.push_back(RunCounters<std::array<std::atomic<std::uint64_t>, kSmokerCount>>(
+      "packed_counters", rounds * 500));
+  results.push_back(RunCounters<PaddedCounters<kSmokerCount, std::atomic<std::uint64_t>>>(
+      "padded_counters", rounds * 500));
+
+  for (const std::size_t per_type : {1, 2}) {
+    results.push_back(RunInventory(per_type, rounds));
+  }
+
+  // 24 раунда в полете по 100 мкс работы: 24 потока-курильщика против пула по числу ядер
+  {
+    constexpr std::size_t kPoolDepth = 24;
+    const auto work = std::chrono::microseconds(100);
+    const int pool_rounds = std::max(1, rounds / 2);
+    results.push_back(Run("mutex_threads", "task_pool", MakeMutex(kPoolDepth),
+                          RunOptions{kPoolDepth / kSmokerCount, kPoolDepth, pool_rounds, false, work}));
+    results.push_back(RunPooled(kPoolDepth, pool_rounds, work));
+  }
+
+  const std::size_t cpu_count = AvailableCpus().size();
+  for (std::size_t tables = 1; tables <= cpu_count; tables *= 2) {
+    results.push_back(RunCluster(tables, rounds));
+  }
+
+  for (const std::size_t tables : {10, 100, 1000}) {
+    results.push_back(RunCoroutines(tables, std::max(1, rounds / static_cast<int>(tables))));
+  }
+
+  if (json) {
+    PrintJson(results);
+  } else {
+    PrintCsv(results);
+  }
+  return 0;
+}
@@ -1,130 +1,758 @@
+#include <algorithm>
 #include <array>
+#include <atomic>
+#include <charconv>
 #include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <optional>
 #include <random>
+#include <span>
+#include <string>
+#include <stop_token>
+#include <string_view>
 #include <thread>
+#include <vector>
 #include <locale.h>
 
 #include "smoking_types.hpp"
 #include "smoking_io.hpp"
 #include "smoking_table.hpp"
+#include "smoking_padding.hpp"
+#include "smoking_simulation.hpp"
+#include "smoking_agent.hpp"
+#include "smoking_trace.hpp"
+#include "smoking_replay.hpp"
+#include "smoking_pool.hpp"
+#include "smoking_metrics.hpp"
+
+// настройки обычного режима из командной строки; по умолчанию - прежняя программа:
+// 12 раундов, по одному курильщику на тип, посредник ждет, пока докурят (глубина 1), 150/300 мс, журнал в консоль
+// - и те же значения по умолчанию, что у SimulationConfig, чтобы --simulate моделировал тот же стол
+struct ThreadModeOptions {
+  AgentPolicy policy{AgentPolicy::kUniform};
+  std::optional<std::uint64_t> seed; // нет - зерно из std::random_device, как раньше
+  std::FILE* trace_file{nullptr};    // куда писать двоичную трассу (nullptr - не писать)
+  std::FILE* record_file{nullptr};   // куда записывать раунды посредника для повтора
+  std::span<const RoundRecord> replay{}; // не пусто - посредник выкладывает пары по этой записи
+  bool pool{false}; // курильщики - задачи WorkStealingPool, а не свои потоки
+  std::uint64_t rounds{12}; // кол-во раундов, которые проведет посредник
+  std::optional<std::chrono::nanoseconds> duration; // вместо числа раундов - выкладывать пары, пока не выйдет время
+  std::size_t smokers_per_type{1}; // сколько взаимозаменяемых курильщиков каждого типа сидит за столом
+  std::size_t depth{1}; // глубина конвейера; больше 1 - посредник выкладывает раунды вперед (--depth)
+  DurationDistribution rolling{DurationDistribution::Constant(std::chrono::milliseconds(150))};
+  std::array<DurationDistribution, kSmokerCount> smoking{
+      DurationDistribution::Constant(std::chrono::milliseconds(300)),
+      DurationDistribution::Constant(std::chrono::milliseconds(300)),
+      DurationDistribution::Constant(std::chrono::milliseconds(300))};
+  bool logging{true}; // false - ни строчки журнала, только отчет (если он включен)
+  bool report{false}; // в конце - отчет JSON в stdout вместо итоговой статистики
+  // курильщики со вторым номером и дальше встают из-за стола и садятся снова раз в столько времени
+  std::optional<std::chrono::nanoseconds> elastic;
+};
+
+// отчет для скриптов нагрузочных прогонов: одна строка JSON
+// ожидания - верхние границы корзин WaitHistogram, то есть с точностью до степени двойки
+void PrintReport(const ThreadModeOptions& options, std::size_t depth, std::uint64_t rounds,
+                 std::chrono::nanoseconds elapsed, std::span<const std::uint64_t> smoked,
+                 const WaitHistogram::Snapshot& place_wait, const WaitHistogram::Snapshot& start_wait) {
+  constexpr std::array<const char*, kSmokerCount> kTypeNames{"tobacco", "paper", "matches"};
+  const double seconds = std::chrono::duration<double>(elapsed).count();
+  const std::string_view policy = AgentPolicyName(options.policy);
+  std::printf("{\"mode\":\"%s\",\"policy\":\"%.*s\",\"smokers_per_type\":%zu,\"depth\":%zu,"
+              "\"rounds\":%llu,\"elapsed_s\":%.6f,\"rounds_per_sec\":%.2f,\"smoked\":[",
+              options.pool ? "pool" : "threads", static_cast<int>(policy.size()), policy.data(),
+              options.smokers_per_type, depth, static_cast<unsigned long long>(rounds), seconds,
+              seconds > 0 ? static_cast<double>(rounds) / seconds : 0.0);
+  for (std::size_t i = 0; i < smoked.size(); ++i) {
+    const std::size_t number = i / kSmokerCount + 1;
+    std::printf("%s{\"type\":\"%s\",\"number\":%zu,\"count\":%llu}", i == 0 ? "" : ",",
+                kTypeNames[i % kSmokerCount], number, static_cast<unsigned long long>(smoked[i]));
+  }
+  std::printf("]");
+  auto print_wait = [](const char* name, const WaitHistogram::Snapshot& wait) {
+    std::printf(",\"%s\":{\"count\":%llu,\"mean\":%llu,\"p50\":%llu,\"p90\":%llu,\"p99\":%llu,\"p999\":%llu}",
+                name, static_cast<unsigned long long>(wait.count),
+                static_cast<unsigned long long>(wait.count == 0 ? 0 : wait.total_ns / wait.count),
+                static_cast<unsigned long long>(wait.percentileNs(0.5)),
+                static_cast<unsigned long long>(wait.percentileNs(0.9)),
+                static_cast<unsigned long long>(wait.percentileNs(0.99)),
+                static_cast<unsigned long long>(wait.percentileNs(0.999)));
+  };
+  print_wait("place_wait_ns", place_wait); // посредник ждет места на столе
+  print_wait("start_wait_ns", start_wait); // курильщик ждет свою пару; в режиме пула - место курильщика, от done() прошлого раунда до startSmoking()
+  std::printf("}\n");
+  std::fflush(stdout);
+}
+
+// обычный режим: настоящие потоки и sleep_for
+int RunThreads(const ThreadModeOptions& options) {
+  const std::size_t worker_count = kSmokerCount * options.smokers_per_type;
+  // глубина конвейера: посредник может выложить столько раундов вперед, не дожидаясь курильщиков
+  // 1 (по умолчанию) - старый режим "выложил пару, жди, пока докурят"; раундов одновременно курится не больше, чем есть курильщиков
+  const std::size_t depth = options.depth;
+  SmokingTable table(depth);
+  AsyncLogger logger; // журнал: потоки кладут строки в свои кольца, печатает фоновый писатель
+  auto log = [&](std::string_view line) { // с --log=off журнал молчит
+    if (options.logging) {
+      logger.log(line);
+    }
+  };
+  TraceRecorder tracer(options.trace_file); // трасса событий для просмотрщика, см. smoking_trace.hpp
+  // кол-во раундов, которые проведет посредник; при повторе - сколько их в записи
+  const std::uint64_t total_rounds = options.replay.empty() ? options.rounds : options.replay.size();
+
+  // счетчик сигарет по каждому из курильщиков
+  // каждый счетчик в своей строке кэша: их пишут разные потоки, и в плотном массиве
+  // каждое ++counter выбивало бы строку у соседей
+  std::vector<CachePadded<int>> smoked_count(worker_count); // value-инициализация: каждый элемент у нас 0, а не просто мусорное значение
+  // живая оценка длительности раунда по типам курильщиков (нс) для политики посредника;
+  // курильщики одного типа пишут ее без блокировки - гонка тут безобидна, это всего лишь оценка
+  PaddedCounters<kSmokerCount, std::atomic<std::int64_t>> service_ns{};
+  WaitHistogram place_wait; // для отчета: сколько посредник ждал в place()
+  WaitHistogram start_wait; // и сколько курильщики ждали в startSmoking()
+  // с --record/--replay раунды копятся целиком: посредник пишет в rounds свою часть записи, а курильщики -
+  // сколько у них шел каждый раунд, каждый в свой вектор round_timings; сводятся они по номеру раунда после прогона
+  const bool keep_rounds = options.record_file != nullptr || !options.replay.empty();
+  std::vector<RoundRecord> rounds;
+  std::vector<std::vector<RoundTiming>> round_timings(worker_count);
+  // генераторы длительностей, по одному на курильщика i (в пуле - на место); посредник со своим - номер 0,
+  // так что с --seed курильщик i берет зерно из seed и i + 1, а не из id потока: id от запуска к запуску
+  // разные, и длительности с тем же --seed не повторялись бы
+  std::vector<std::mt19937_64> duration_rngs;
+  duration_rngs.reserve(worker_count);
+  for (std::size_t i = 0; i < worker_count; ++i) {
+    if (options.seed) {
+      std::seed_seq seq{static_cast<std::uint32_t>(*options.seed), static_cast<std::uint32_t>(*options.seed >> 32),
+                        static_cast<std::uint32_t>(i + 1)};
+      duration_rngs.emplace_back(seq);
+    } else {
+      duration_rngs.emplace_back(std::random_device{}());
+    }
+  }
+
+  // один раунд курильщика после того, как он забрал пару: скрутить, выкурить, записать в журнал
+  // раунд идет шагами take_round -> rolled_round -> finish_round, между ними - паузы на скручивание и курение:
+  // поток курильщика спит в них сам (smoke_round), а в режиме пула (--pool) паузы отсчитывает таймер пула
+  // длительности берутся из распределений; у каждого курильщика свой генератор (duration_rngs)
+  struct RoundPlan {
+    Ingredient ingredient;
+    std::string_view label;
+    int cigarette;
+    std::chrono::nanoseconds rolling; // время на скручивание сигареты
+    std::chrono::nanoseconds smoking; // время на курение
+    std::chrono::steady_clock::time_point taken_at;
+  };
+
+  auto take_round = [&](Ingredient ingredient, std::string_view label, int cigarette, std::mt19937_64& duration_rng) {
+    const RoundPlan plan{ingredient, label, cigarette, options.rolling.sample(duration_rng),
+                         options.smoking[IngredientIndex(ingredient)].sample(duration_rng),
+                         std::chrono::steady_clock::now()};
+    LineBuffer message;
+    FormatSmokerTake(message, label, ingredient);
+    log(message.view());
+    return plan;
+  };
+
+  auto rolled_round = [&](const RoundPlan& plan) {
+    LineBuffer message;
+    FormatSmokerRolled(message, plan.label, plan.cigarette);
+    log(message.view());
+  };
+
+  auto finish_round = [&](const RoundPlan& plan) {
+    {
+      LineBuffer message;
+      FormatSmokerFinished(message, plan.label, plan.cigarette);
+      log(message.view());
+    }
+    // скользящее среднее с весом 1/8, как в RunSimulation
+    const std::int64_t took = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - plan.taken_at).count();
+    auto& service = service_ns[IngredientIndex(plan.ingredient)];
+    const std::int64_t old = service.load(std::memory_order_relaxed);
+    service.store(old == 0 ? took : old + (took - old) / 8, std::memory_order_relaxed);
+  };
+
+  // раунд целиком в потоке курильщика
+  auto smoke_round = [&](Ingredient ingredient, std::string_view label, int cigarette, std::mt19937_64& rng) {
+    const auto who = static_cast<std::uint8_t>(IngredientIndex(ingredient));
+    const RoundPlan plan = take_round(ingredient, label, cigarette, rng);
+
+    tracer.begin(TraceEvent::kRoll, who, static_cast<std::uint32_t>(cigarette));
+    if (plan.rolling.count() > 0) { // нулевое время - не зовем sleep_for вовсе
+      std::this_thread::sleep_for(plan.rolling); // sleep_for() — спать относительное время
+    }
+    tracer.end(TraceEvent::kRoll, who, static_cast<std::uint32_t>(cigarette));
+    rolled_round(plan);
+
+    tracer.begin(TraceEvent::kSmoke, who, static_cast<std::uint32_t>(cigarette));
+    if (plan.smoking.count() > 0) {
+      std::this_thread::sleep_for(plan.smoking);
+    }
+    tracer.end(TraceEvent::kSmoke, who, static_cast<std::uint32_t>(cigarette));
+    finish_round(plan);
+  };
 
-int main() {
-  setlocale(LC_ALL, "Russian");
-  SmokingTable table; 
-  std::mutex io_mutex; // мьютекс для логов
-  constexpr int kTotalRounds = 12; // кол-во раундов, которые проведет посредник
-  const auto rolling_duration = std::chrono::milliseconds(150); // время на скручивание сигареты
-  const auto smoking_duration = std::chrono::milliseconds(300); // время на курение
-
-  // счетчик сигарет по каждому из курильщиков 
-  std::array<int, kSmokerCount> smoked_count{}; // {} - value-инициализация всех элементов, т.е. каждый элемент у нас 0, а не просто мусорное значение
-  
   // поток курильщика
-  // лямбда-функция 
+  // лямбда-функция
   // [&] - захват по ссылке всего, что будет использовано из внешней области
   // Ingredient ingredient - что именно у этого курильщика своё, т.е. тип курильщика
+  // std::string_view label - имя курильщика с его номером в пуле
   // int& counter — ссылка на уже существующий счётчик этого курильщика
-  auto smoker_task = [&](Ingredient ingredient, int& counter) {  
-    const auto components = ComponentsFor(ingredient); // 2 недостающих компонента для рассматриваемого курильщика
+  // сообщения собираются в LineBuffer на стеке, в цикле раунда память не выделяется
+  // std::stop_token stop - с --elastic по нему курильщика снимают со стола; за стол (joinSmoker) его
+  // сажает вызывающий: первый раз - main до старта посредника, дальше - smoker_task на каждом заходе
+  // rng - генератор длительностей этого курильщика
+  // timings - куда с --record/--replay писать, сколько шел каждый раунд; с --elastic номер раунда
+  // стол не сообщает (startSmokingOrLeave()), и раунды остаются незамеренными
+  auto smoke_at_table = [&](std::stop_token stop, Ingredient ingredient, std::string_view label, int& counter,
+                            std::mt19937_64& rng, std::vector<RoundTiming>& timings) {
+    const auto who = static_cast<std::uint8_t>(IngredientIndex(ingredient));
     while (true) { // поток курильщика
-      if (!table.startSmoking(ingredient)) {
+      tracer.begin(TraceEvent::kTake, who, static_cast<std::uint32_t>(counter + 1));
+      const auto waiting_since = std::chrono::steady_clock::now();
+      std::uint64_t round = 0; // номер забранного раунда на столе
+      if (!(options.elastic ? table.startSmokingOrLeave(ingredient, stop)
+                            : (round = table.startSmokingRound(ingredient)) != 0)) {
+        tracer.end(TraceEvent::kTake, who, static_cast<std::uint32_t>(counter + 1));
         break; // выход из цикла, если у нас курит другой курильщик
       }
+      const auto taken = std::chrono::steady_clock::now();
+      start_wait.record(taken - waiting_since);
 
       ++counter;
+      tracer.end(TraceEvent::kTake, who, static_cast<std::uint32_t>(counter));
+      smoke_round(ingredient, label, counter, rng);
+      if (keep_rounds && round != 0) {
+        timings.push_back({round, std::chrono::steady_clock::now() - taken});
+      }
 
       {
-        std::string message = SmokerLabel(ingredient) +
-                               " забирает " +
-                               std::string{IngredientToString(components[0])} +
-                               " и " +
-                               std::string{IngredientToString(components[1])} +
-                               ".";
-        PrintMessage(io_mutex, message);
+        TraceScope scope(tracer, TraceEvent::kFinish, who, static_cast<std::uint32_t>(counter));
+        table.finishSmoking();
       }
+    }
 
-      std::this_thread::sleep_for(rolling_duration); // sleep_for() — спать относительное время
+    LineBuffer message;
+    message << label << (stop.stop_requested() ? " встает из-за стола." : " завершает работу.");
+    log(message.view());
+  };
 
+  // --elastic: сменные курильщики (второй номер в пуле и дальше) то встают из-за стола, то садятся снова
+  // это все те же потоки: встав, поток ждет здесь следующего захода, а не завершается, -
+  // у каждого потока свое кольцо журнала и буфер трассы, и новые потоки на каждый заход копили бы их без конца
+  struct Seating {
+    std::mutex mutex;
+    std::condition_variable_any cv;
+    bool seated{true};        // сменным пора сидеть за столом
+    std::size_t at_table{0};  // сколько сменных сейчас за столом
+    std::stop_source stint{}; // по нему сменные встают; на каждый заход - новый
+  } seating;
+
+  // поток курильщика; relief - сменный, его то снимают со стола, то сажают обратно (только с --elastic)
+  // std::stop_token stop - его дает std::jthread: по нему сменный перестает ждать захода
+  // на первый заход main уже посадил сменного за стол, поэтому он не ждет seated, а садится сразу -
+  // даже если смену уже сняли, пока поток запускался: тогда он тут же уйдет, и стол вычеркнет его из состава
+  auto smoker_task = [&](std::stop_token stop, Ingredient ingredient, std::string_view label, int& counter,
+                         std::mt19937_64& rng, std::vector<RoundTiming>& timings, bool relief) {
+    if (!relief) {
+      smoke_at_table(stop, ingredient, label, counter, rng, timings);
+      return;
+    }
+    for (bool joined = true;; joined = false) {
+      std::stop_token stint;
       {
-        std::string message = SmokerLabel(ingredient) +
-                               " скрутил сигарету #" +
-                               std::to_string(counter) + ".";
-        PrintMessage(io_mutex, message);
+        std::unique_lock<std::mutex> lock(seating.mutex);
+        if (!joined && !seating.cv.wait(lock, stop, [&] { return seating.seated; })) {
+          return; // прогон кончился, пока ждали
+        }
+        stint = seating.stint.get_token();
+        ++seating.at_table;
       }
-
-      std::this_thread::sleep_for(smoking_duration);
-
+      if (!joined) {
+        table.joinSmoker(ingredient);
+      }
+      smoke_at_table(stint, ingredient, label, counter, rng, timings);
       {
-        std::string message = SmokerLabel(ingredient) +
-                               " докурил сигарету #" +
-                               std::to_string(counter) + ".";
-        PrintMessage(io_mutex, message);
+        std::lock_guard<std::mutex> lock(seating.mutex);
+        --seating.at_table;
+      }
+      seating.cv.notify_all();
+      if (!stint.stop_requested()) {
+        return; // ушел не по вызову - стол закрыт
       }
-      
-      table.finishSmoking();
     }
-
-    PrintMessage(io_mutex, SmokerLabel(ingredient) + " завершает работу.");
   };
 
   // поток посредника
-  auto agent_task = [&](int total_rounds) {
-    std::mt19937 rng(std::random_device{}()); // генератор псевдослучайных чисел
-    std::uniform_int_distribution<int> dist(
-        0, static_cast<int>(kAllSmokers.size()) - 1); // равномерное распределение в диапазоне от [0; 2]
-
-    for (int round = 1; round <= total_rounds; ++round) {
-      const Ingredient smoker_with_supply =
-          kAllSmokers[static_cast<std::size_t>(dist(rng))]; // случайно выбираем какому курильщику будет подходить след. пара компонентов
-      const auto components = ComponentsFor(smoker_with_supply); // та самая пара компонентов
-      
+  std::uint64_t placed_rounds = 0;
+  std::uint64_t rejected_pairs = 0; // пары, которые стол не принял (place() вернул false)
+  std::chrono::nanoseconds elapsed{0}; // от начала работы посредника до конца последнего раунда
+  auto agent_task = [&]() {
+    const auto start = std::chrono::steady_clock::now();
+    if (!options.replay.empty()) { // повтор записи: пары и их порядок - из файла, без пауз между раундами
       {
-        std::string message =
-            "Посредник выкладывает " +
-            std::string{IngredientToString(components[0])} + " и " +
-            std::string{IngredientToString(components[1])} + " для " +
-            SmokerLabel(smoker_with_supply) +
-            ". Раунд #" + std::to_string(round) + ".";
-        PrintMessage(io_mutex, message);
+        LineBuffer message;
+        message << "Посредник повторяет запись: " << options.replay.size() << " раундов.";
+        log(message.view());
+      }
+      rounds = ReplayRounds(table, options.replay); // сам дожидается конца последнего раунда
+      for (const RoundRecord& round : rounds) {
+        place_wait.record(std::chrono::nanoseconds(round.place_ns));
       }
+      placed_rounds = rounds.size();
+      elapsed = std::chrono::steady_clock::now() - start;
+      log("Все раунды завершены.");
+      table.finish();
+      log("Посредник завершает работу.");
+      return;
+    }
 
-      table.place(components[0], components[1]);
+    std::mt19937 rng(options.seed ? static_cast<std::mt19937::result_type>(*options.seed)
+                                  : std::random_device{}()); // генератор псевдослучайных чисел (нужен политике uniform)
+    AgentPicker picker(options.policy); // кому выложить следующую пару, см. smoking_agent.hpp
+    if (keep_rounds && !options.duration) {
+      rounds.reserve(total_rounds);
+    }
+    // с --duration посредник выкладывает пары, пока не выйдет время
+    const bool timed = options.duration.has_value();
+    const auto deadline = start + options.duration.value_or(std::chrono::nanoseconds{0});
 
-      table.waitForRoundEnd();
+    const bool uses_view = picker.usesView(); // uniform и round-robin на стол не смотрят - не берем его мьютекс зря
+    for (std::uint64_t round = 1; timed ? std::chrono::steady_clock::now() < deadline : round <= total_rounds;
+         ++round) {
+      AgentView view; // что посредник видит на столе перед выбором
+      if (uses_view) {
+        // свободные минус пары этого типа, которые уже лежат на столе и ждут их, - как в RunSimulation;
+        // оба числа - из одного снимка, под одной блокировкой
+        const auto counts = table.smokerCounts();
+        for (std::size_t type = 0; type < kSmokerCount; ++type) {
+          view.free[type] = counts.free(type);
+          view.service[type] = std::chrono::nanoseconds(service_ns[type].load(std::memory_order_relaxed));
+        }
+      }
+      const Ingredient smoker_with_supply = picker.next(rng, view); // какому курильщику будет подходить след. пара компонентов
+      const auto components = ComponentsFor(smoker_with_supply); // та самая пара компонентов
+
+      {
+        LineBuffer message;
+        FormatAgentPlace(message, smoker_with_supply, static_cast<int>(round));
+        log(message.view());
+      }
 
+      const auto started = std::chrono::steady_clock::now();
+      bool accepted = false;
       {
-        std::string message = "Раунд #" + std::to_string(round) +
-                               " завершен.";
-        PrintMessage(io_mutex, message);
+        TraceScope scope(tracer, TraceEvent::kPlace, kTraceAgent, static_cast<std::uint32_t>(round));
+        accepted = table.place(components[0], components[1]); // ждет только при заполненном конвейере
       }
+      const auto placed = std::chrono::steady_clock::now();
+      if (!accepted) { // с --elastic - за столом нет ни одного курильщика этого типа; раундом это не считаем
+        ++rejected_pairs;
+        LineBuffer message;
+        message << "Стол не принял пару для " << SmokerLabelView(smoker_with_supply) << ": за столом таких нет.";
+        log(message.view());
+      } else {
+        place_wait.record(placed - started);
+        ++placed_rounds;
+        // только принятые пары: запись n - это раунд n на столе, по нему MergeRoundTimings сводит замеры курильщиков
+        if (keep_rounds) {
+          rounds.push_back(MakeRoundRecord(smoker_with_supply, started - start, placed - started));
+        }
+      }
+    }
+
+    table.waitForRoundEnd(); // дожидаемся, пока докурят все выложенные раунды
+    elapsed = std::chrono::steady_clock::now() - start;
+    log("Все раунды завершены.");
+    if (rejected_pairs > 0) {
+      LineBuffer message;
+      message << "Пар не принято столом: " << rejected_pairs << ".";
+      log(message.view());
     }
 
     table.finish();
-    PrintMessage(io_mutex, "Посредник завершает работу.");
+    log("Посредник завершает работу.");
   };
 
-  std::array<std::thread, kSmokerCount> smokers{}; // массив потоков курильщиков
-  for (std::size_t i = 0; i < smokers.size(); ++i) { // запуск трех потоков курильщиков
-    smoked_count[i] = 0;
-    smokers[i] = std::thread(smoker_task, kAllSmokers[i], // конструируем временный объект потока и запускаем в нем лямбда-функцию
-                             std::ref(smoked_count[i]));
+  // курильщик i имеет тип kAllSmokers[i % kSmokerCount] и номер i / kSmokerCount + 1 в своем пуле
+  std::vector<LabelBuffer> labels(worker_count);
+  for (std::size_t i = 0; i < labels.size(); ++i) {
+    FormatWorkerLabel(labels[i], kAllSmokers[i % kSmokerCount], i / kSmokerCount + 1);
   }
 
-  std::thread agent(agent_task, kTotalRounds);
+  std::vector<std::jthread> smokers; // потоки курильщиков
+  // режим пула: по диспетчеру на тип забирают пары и отдают раунды в пул по числу ядер;
+  // курильщики те же smokers_per_type на тип, только это места, а не потоки: курильщик i - место
+  // i / kSmokerCount своего типа, и счет сигарет и ожидание пары ведутся по нему, как у потоков
+  // скручивание и курение - таймер пула (submitAfter), так что поток пула свободен, пока раунд в паузе;
+  // поэтому kRoll/kSmoke в трассе пула нет - их не выполняет ни один поток
+  std::optional<WorkStealingPool> pool;
+  std::optional<PooledSmokers<SmokingTable>> pooled;
+  if (options.pool) {
+    pool.emplace();
+    pooled.emplace(table, *pool, options.smokers_per_type, [&](const PooledSmokers<SmokingTable>::Round& round) {
+      const std::size_t i = round.seat * kSmokerCount + IngredientIndex(round.smoker);
+      start_wait.record(round.waited);
+      const RoundPlan plan = take_round(round.smoker, labels[i].view(), ++smoked_count[i].value, duration_rngs[i]);
+      pool->submitAfter(plan.rolling, [&, plan, round, i] {
+        rolled_round(plan);
+        pool->submitAfter(plan.smoking, [&, plan, round, i] {
+          finish_round(plan);
+          if (keep_rounds && round.number != 0) { // место i занято до done() - его вектор пишем только мы
+            round_timings[i].push_back({round.number, std::chrono::steady_clock::now() - plan.taken_at});
+          }
+          round.done();
+        });
+      });
+    });
+  } else {
+    if (options.elastic) {
+      // весь состав садится за стол до старта посредника: с первого joinSmoker() стол отвергает пары
+      // типам без курильщиков, и joinSmoker() из потоков курильщиков опаздывал бы к первым раундам
+      for (std::size_t i = 0; i < worker_count; ++i) {
+        table.joinSmoker(kAllSmokers[i % kSmokerCount]);
+      }
+    }
+    for (std::size_t i = 0; i < worker_count; ++i) { // запуск потоков курильщиков, по smokers_per_type на тип
+      smokers.emplace_back(smoker_task, kAllSmokers[i % kSmokerCount], // конструируем объект потока и запускаем в нем лямбда-функцию
+                           labels[i].view(), std::ref(smoked_count[i].value), std::ref(duration_rngs[i]),
+                           std::ref(round_timings[i]),
+                           options.elastic.has_value() && i >= kSmokerCount);
+    }
+  }
+
+  std::thread agent(agent_task);
+
+  // --elastic: пока посредник работает, сменные курильщики то встают из-за стола,
+  // то садятся снова - стол при этом не останавливается; первый курильщик каждого типа сидит все время
+  std::jthread scaler;
+  if (options.elastic && !options.pool && options.smokers_per_type > 1) {
+    scaler = std::jthread([&](std::stop_token stop) {
+      std::mutex mutex;
+      std::condition_variable_any cv;
+      auto wait_period = [&] {
+        std::unique_lock<std::mutex> lock(mutex);
+        cv.wait_for(lock, stop, *options.elastic, [] { return false; });
+        return !stop.stop_requested();
+      };
+      while (wait_period()) {
+        {
+          std::unique_lock<std::mutex> lock(seating.mutex);
+          seating.seated = false;
+          seating.stint.request_stop(); // каждый докурит свой раунд и уйдет
+          if (!seating.cv.wait(lock, stop, [&] { return seating.at_table == 0; })) {
+            break;
+          }
+        }
+        log("За столом остались по одному курильщику каждого типа.");
+        if (!wait_period()) {
+          break;
+        }
+        {
+          std::lock_guard<std::mutex> lock(seating.mutex);
+          seating.stint = std::stop_source{};
+          seating.seated = true;
+        }
+        seating.cv.notify_all();
+        LineBuffer message;
+        message << "За стол снова сели все курильщики: " << smokers.size() << ".";
+        log(message.view());
+      }
+    });
+  }
 
   agent.join(); // текущий поток (main) ждёт, пока поток agent (посредник) полностью завершится
+  if (scaler.joinable()) {
+    scaler.request_stop();
+    scaler.join();
+  }
+  if (options.elastic) {
+    for (std::size_t i = kSmokerCount; i < smokers.size(); ++i) {
+      smokers[i].request_stop(); // сменные, которые ждут захода, больше не ждут; за столом все уже ушли по finish()
+    }
+  }
+  if (pooled) {
+    pooled->join();
+  }
   for (auto& smoker : smokers) {
     if (smoker.joinable()) { // владеет ли этот объект std::thread smoker действующим потоком?
-      smoker.join(); // ждем завершения конркетного курильщика, который курит 
+      smoker.join(); // ждем завершения конркетного курильщика, который курит
+    }
+  }
+
+  tracer.flush(); // все потоки остановлены - дописываем их буферы
+
+  if (keep_rounds) { // все курильщики остановлены - их замеры можно сводить с записью посредника
+    for (const auto& timings : round_timings) {
+      MergeRoundTimings(rounds, timings);
     }
   }
+  if (options.record_file != nullptr) {
+    RoundRecorder recorder(options.record_file);
+    for (const RoundRecord& round : rounds) {
+      recorder.record(round);
+    }
+  }
+  if (!options.replay.empty()) {
+    const ReplayComparison comparison = CompareReplays(options.replay, rounds);
+    LineBuffer message;
+    message << "Повтор: " << comparison.rounds << " раундов, пары не совпали в "
+            << comparison.smoker_mismatches << ", ожидание в place() всего было/стало, мкс: "
+            << comparison.baseline_place_total.count() / 1000 << "/"
+            << comparison.candidate_place_total.count() / 1000
+            << ", худший раунд #" << comparison.slowest_round + 1 << " дольше на "
+            << comparison.max_place_slowdown.count() / 1000 << " мкс.";
+    log(message.view());
+    LineBuffer smoked; // в одну строку журнала (256 байт) оба сравнения не влезают
+    smoked << "Повтор: раунд у курильщика (замерен в обоих прогонах: " << comparison.smoked_rounds
+           << ") всего было/стало, мкс: " << comparison.baseline_smoke_total.count() / 1000 << "/"
+           << comparison.candidate_smoke_total.count() / 1000 << ", худший раунд #"
+           << comparison.slowest_smoke_round + 1 << " дольше на " << comparison.max_smoke_slowdown.count() / 1000
+           << " мкс.";
+    log(smoked.view());
+  }
 
-  PrintMessage(io_mutex, "Итоговая статистика:");
+  if (options.report) {
+    std::vector<std::uint64_t> smoked;
+    for (const auto& count : smoked_count) {
+      smoked.push_back(static_cast<std::uint64_t>(count.value));
+    }
+    logger.flush(); // журнал (если он включен) пишет в тот же stdout - отчет идет после него
+    PrintReport(options, depth, placed_rounds, elapsed, smoked, place_wait.snapshot(), start_wait.snapshot());
+    return 0;
+  }
+
+  log("Итоговая статистика:");
   for (std::size_t i = 0; i < smoked_count.size(); ++i) {
-    std::string message = SmokerLabel(kAllSmokers[i]) + " выкурил " +
-                          std::to_string(smoked_count[i]) + " сигарет.";
-    PrintMessage(io_mutex, message);
+    LineBuffer message;
+    message << labels[i].view() << " выкурил " << smoked_count[i].value << " сигарет.";
+    log(message.view());
+  }
+  if (options.pool) {
+    LineBuffer message;
+    message << "Потоков в пуле: " << pool->size() << ".";
+    log(message.view());
   }
 
+#ifdef SMOKING_TABLE_METRICS
+  {
+    const auto metrics = table.snapshot();
+    LineBuffer message;
+    message << "Метрики: раундов " << metrics.rounds_completed
+            << ", пробуждений курильщиков " << metrics.smoker_wakeups
+            << ", из них впустую " << metrics.spurious_wakeups
+            << ", ожидание в place() p50/p99, нс: " << metrics.place_wait.percentileNs(0.5)
+            << "/" << metrics.place_wait.percentileNs(0.99)
+            << ", пробуждение курильщика p50/p99, нс: " << metrics.wake_latency.percentileNs(0.5)
+            << "/" << metrics.wake_latency.percentileNs(0.99) << ".";
+    log(message.view());
+  }
+#endif
+
   return 0;
 }
+
+// режим моделирования: виртуальное время, печатается только итог
+int RunSimulationMode(const SimulationConfig& config) {
+  const SimulationResult result = RunSimulation(config);
+  AsyncLogger logger;
+  LineBuffer message;
+  message << "Моделирование: " << result.rounds << " раундов за "
+          << std::chrono::duration_cast<std::chrono::milliseconds>(result.elapsed).count()
+          << " мс виртуального времени, раундов в секунду: "
+          << result.roundsPerSecond() << ".";
+  logger.log(message.view());
+
+  message.clear();
+  message << "Ожидание пары p50/p99, мс: "
+          << std::chrono::duration_cast<std::chrono::milliseconds>(result.latencyPercentile(0.5)).count()
+          << "/"
+          << std::chrono::duration_cast<std::chrono::milliseconds>(result.latencyPercentile(0.99)).count()
+          << ", справедливость (индекс Джейна): " << result.fairness()
+          << ", политика посредника: " << AgentPolicyName(config.policy) << ".";
+  logger.log(message.view());
+
+  for (std::size_t i = 0; i < result.smoked_count.size(); ++i) {
+    LabelBuffer label;
+    FormatWorkerLabel(label, kAllSmokers[i % kSmokerCount], i / kSmokerCount + 1);
+    message.clear();
+    message << label.view() << " выкурил " << result.smoked_count[i] << " сигарет.";
+    logger.log(message.view());
+  }
+  return 0;
+}
+
+// целое неотрицательное число из аргумента командной строки
+std::optional<std::uint64_t> ParseCount(std::string_view text) {
+  std::uint64_t value = 0;
+  const auto result = std::from_chars(text.data(), text.data() + text.size(), value);
+  if (result.ec != std::errc{} || result.ptr != text.data() + text.size()) {
+    return std::nullopt;
+  }
+  return value;
+}
+
+// без аргументов - обычный режим с потоками, как прежняя программа: 12 раундов, по курильщику на тип,
+// посредник ждет каждый раунд, 150/300 мс; конвейер и пулы курильщиков - только через --depth и --smokers-per-type
+// [--simulate] [--rounds=N] [--depth=D] [--smokers-per-type=M] [--roll=РАСПР] [--smoke=РАСПР] [--seed=S]
+// - те же настройки и для потоков, и для моделирования
+// РАСПР (в мс): 300, const:300, uniform:100:500, exp:300; 0 - вовсе без sleep_for
+// --duration=МС - вместо числа раундов посредник выкладывает пары, пока не выйдет время (только обычный режим)
+// --log=off - без журнала; --report=json - в конце одна строка JSON (раунды в секунду, сигареты
+// по курильщикам, перцентили ожидания) вместо итоговой статистики; вместе - прогон для скриптов:
+//   project_part_1 --rounds=100000 --roll=0 --smoke=0 --log=off --report=json
+// --elastic=МС - раз в МС миллисекунд курильщики со вторым номером и дальше (--smokers-per-type=2 и больше) встают из-за стола
+// и садятся обратно, не останавливая стол (SmokingTable::joinSmoker/startSmokingOrLeave; не с --pool)
+// --smoke=РАСПР,РАСПР,РАСПР - свое распределение для табака, бумаги и спичек
+// --policy=uniform|round-robin|lrs|deficit - как посредник выбирает пару (в обоих режимах)
+// --trace=ФАЙЛ - записать двоичную трассу потоков (только обычный режим); в JSON ее переводит trace2json
+// --record=ФАЙЛ - записать раунды (пары, ожидание place() и сколько раунд шел у курильщика; файл пишется
+// в конце прогона), --replay=ФАЙЛ - выложить пары по записи и сравнить оба замера раунд за раундом;
+// пустая запись - ошибка; --seed=S в обычном режиме - зерно посредника
+// --pool - раунды курильщиков выполняет пул потоков по числу ядер (с перехватом работы), а не поток на курильщика
+int main(int argc, char** argv) {
+  setlocale(LC_ALL, "Russian");
+  bool simulate = false;
+  std::string_view trace_path;
+  std::string_view record_path;
+  std::string_view replay_path;
+  ThreadModeOptions options;
+  SimulationConfig config;
+  for (int i = 1; i < argc; ++i) {
+    const std::string_view arg = argv[i];
+    auto value_of = [&arg](std::string_view key) -> std::optional<std::string_view> {
+      if (arg.substr(0, key.size()) == key) {
+        return arg.substr(key.size());
+      }
+      return std::nullopt;
+    };
+    bool ok = true;
+    if (arg == "--simulate") {
+      simulate = true;
+    } else if (const auto value = value_of("--rounds=")) {
+      const auto count = ParseCount(*value);
+      ok = count.has_value();
+      config.rounds = count.value_or(0);
+      options.rounds = config.rounds;
+    } else if (const auto value = value_of("--depth=")) {
+      const auto count = ParseCount(*value);
+      ok = count.value_or(0) >= 1;
+      config.depth = count.value_or(1);
+      options.depth = config.depth;
+    } else if (const auto value = value_of("--smokers-per-type=")) {
+      const auto count = ParseCount(*value);
+      ok = count.value_or(0) >= 1;
+      config.smokers_per_type = count.value_or(1);
+      options.smokers_per_type = config.smokers_per_type;
+    } else if (const auto value = value_of("--seed=")) {
+      const auto count = ParseCount(*value);
+      ok = count.has_value();
+      config.seed = count.value_or(0);
+      options.seed = count;
+    } else if (const auto value = value_of("--roll=")) {
+      const auto distribution = ParseDurationDistribution(*value);
+      ok = distribution.has_value();
+      if (ok) {
+        config.rolling = *distribution;
+      }
+    } else if (const auto value = value_of("--smoke=")) {
+      if (value->find(',') == std::string_view::npos) {
+        const auto distribution = ParseDurationDistribution(*value);
+        ok = distribution.has_value();
+        if (ok) {
+          config.smoking.fill(*distribution);
+        }
+      } else { // по распределению на каждый тип через запятую
+        std::string_view rest = *value;
+        for (std::size_t type = 0; type < kSmokerCount && ok; ++type) {
+          const auto comma = rest.find(',');
+          const auto distribution = ParseDurationDistribution(rest.substr(0, comma));
+          ok = distribution.has_value() && (comma == std::string_view::npos) == (type + 1 == kSmokerCount);
+          if (ok) {
+            config.smoking[type] = *distribution;
+            rest = comma == std::string_view::npos ? std::string_view{} : rest.substr(comma + 1);
+          }
+        }
+      }
+    } else if (const auto value = value_of("--duration=")) {
+      double ms = 0;
+      const auto result = std::from_chars(value->data(), value->data() + value->size(), ms);
+      ok = result.ec == std::errc{} && result.ptr == value->data() + value->size() && ms > 0;
+      options.duration = std::chrono::nanoseconds(static_cast<std::int64_t>(ms * 1e6));
+    } else if (arg == "--log=off" || arg == "--log=on") {
+      options.logging = arg == "--log=on";
+    } else if (const auto value = value_of("--elastic=")) {
+      const auto ms = ParseCount(*value);
+      ok = ms.value_or(0) >= 1;
+      options.elastic = std::chrono::milliseconds(ms.value_or(1));
+    } else if (arg == "--report=json") {
+      options.report = true;
+    } else if (const auto value = value_of("--trace=")) {
+      trace_path = *value;
+      ok = !trace_path.empty();
+    } else if (arg == "--pool") {
+      options.pool = true;
+    } else if (const auto value = value_of("--record=")) {
+      record_path = *value;
+      ok = !record_path.empty();
+    } else if (const auto value = value_of("--replay=")) {
+      replay_path = *value;
+      ok = !replay_path.empty();
+    } else if (const auto value = value_of("--policy=")) {
+      const auto policy = ParseAgentPolicy(*value);
+      ok = policy.has_value();
+      config.policy = policy.value_or(AgentPolicy::kUniform);
+    } else {
+      ok = false;
+    }
+    if (!ok) {
+      std::fprintf(stderr, "неизвестный или неверный аргумент: %s\n", argv[i]);
+      return 1;
+    }
+  }
+
+  if (simulate) {
+    return RunSimulationMode(config);
+  }
+  options.policy = config.policy;
+  options.rolling = config.rolling;
+  options.smoking = config.smoking;
+  auto open_output = [](std::string_view path) -> std::FILE* {
+    std::FILE* file = std::fopen(std::string(path).c_str(), "wb");
+    if (file == nullptr) {
+      std::fprintf(stderr, "не удалось открыть файл: %.*s\n", static_cast<int>(path.size()), path.data());
+    }
+    return file;
+  };
+  const std::optional<ReplaySchedule> schedule = replay_path.empty()
+                                                     ? std::optional<ReplaySchedule>{}
+                                                     : ReplaySchedule::Open(std::string(replay_path));
+  if (!replay_path.empty()) {
+    if (!schedule) {
+      std::fprintf(stderr, "не удалось прочитать запись раундов или в ней нет ни одного раунда: %.*s\n",
+                   static_cast<int>(replay_path.size()), replay_path.data());
+      return 1;
+    }
+    options.replay = schedule->rounds();
+  }
+  if (!trace_path.empty() && (options.trace_file = open_output(trace_path)) == nullptr) {
+    return 1;
+  }
+  if (!record_path.empty() && (options.record_file = open_output(record_path)) == nullptr) {
+    if (options.trace_file != nullptr) {
+      std::fclose(options.trace_file);
+    }
+    return 1;
+  }
+  const int status = RunThreads(options);
+  for (std::FILE* file : {options.trace_file, options.record_file}) {
+    if (file != nullptr) {
+      std::fclose(file);
+    }
+  }
+  return status;
+}
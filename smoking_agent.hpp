@@ -0,0 +1,200 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <random>
+#include <string_view>
+#include <type_traits>
+#include <variant>
+
+#include "smoking_types.hpp"
+
+
+// как посредник выбирает, чью пару выложить следующей
+// пары забираются строго по порядку, поэтому пара для типа, у которого все курильщики заняты,
+// стоит в голове очереди и держит всех остальных; выбирать с оглядкой на свободных выгоднее
+
+// что посредник знает о столе в момент выбора
+struct AgentView {
+  // сколько курильщиков каждого типа свободны и еще не "заняты" парами, уже лежащими на столе
+  std::array<std::size_t, kSmokerCount> free{};
+  // текущая оценка времени одного раунда (скрутить + выкурить) каждого типа; 0 - еще не знаем
+  std::array<std::chrono::nanoseconds, kSmokerCount> service{};
+};
+
+// каждая политика говорит kUsesView, смотрит ли она в AgentView: если нет, посредник его не собирает
+// и не ходит лишний раз за мьютексом стола
+
+// равномерно случайно, как было в agent_task; на стол не смотрит
+class UniformPicker {
+ public:
+  static constexpr bool kUsesView = false;
+
+  template <typename Rng>
+  Ingredient next(Rng& rng, const AgentView&) {
+    return kAllSmokers[dist_(rng)];
+  }
+
+ private:
+  std::uniform_int_distribution<std::size_t> dist_{0, kSmokerCount - 1};
+};
+
+// по кругу: табак, бумага, спички, табак...
+class RoundRobinPicker {
+ public:
+  static constexpr bool kUsesView = false;
+
+  template <typename Rng>
+  Ingredient next(Rng&, const AgentView&) {
+    const Ingredient smoker = kAllSmokers[next_];
+    next_ = (next_ + 1) % kSmokerCount;
+    return smoker;
+  }
+
+ private:
+  std::size_t next_{0};
+};
+
+// тот, кого дольше всех не обслуживали, но из тех, у кого есть свободный курильщик
+// если свободных нет ни у кого - просто самый давний
+class LeastRecentlyServedPicker {
+ public:
+  static constexpr bool kUsesView = true;
+
+  template <typename Rng>
+  Ingredient next(Rng&, const AgentView& view) {
+    std::optional<std::size_t> best;
+    for (std::size_t i = 0; i < kSmokerCount; ++i) {
+      if (view.free[i] > 0 && (!best || last_served_[i] < last_served_[*best])) {
+        best = i;
+      }
+    }
+    if (!best) {
+      best = 0;
+      for (std::size_t i = 1; i < kSmokerCount; ++i) {
+        if (last_served_[i] < last_served_[*best]) {
+          best = i;
+        }
+      }
+    }
+    last_served_[*best] = ++tick_;
+    return kAllSmokers[*best];
+  }
+
+ private:
+  std::array<std::uint64_t, kSmokerCount> last_served_{};
+  std::uint64_t tick_{0};
+};
+
+// взвешенный дефицит: на каждом выборе тип i получает кредит w_i, выбранный тратит 1
+// вес обратно пропорционален времени раунда типа (по живым замерам из view.service),
+// то есть быстрые курят чаще, но медленные копят кредит и не голодают
+// из типов со свободными курильщиками берем того, у кого кредит больше
+class WeightedDeficitPicker {
+ public:
+  static constexpr bool kUsesView = true;
+
+  template <typename Rng>
+  Ingredient next(Rng&, const AgentView& view) {
+    std::array<double, kSmokerCount> weight{};
+    double total = 0;
+    for (std::size_t i = 0; i < kSmokerCount; ++i) {
+      const auto service = view.service[i].count();
+      weight[i] = service > 0 ? 1.0 / static_cast<double>(service) : 0.0;
+      total += weight[i];
+    }
+    for (std::size_t i = 0; i < kSmokerCount; ++i) {
+      deficit_[i] += total > 0 ? weight[i] / total : 1.0 / kSmokerCount; // пока замеров нет - поровну
+    }
+
+    std::optional<std::size_t> best;
+    for (std::size_t i = 0; i < kSmokerCount; ++i) {
+      if (view.free[i] > 0 && (!best || deficit_[i] > deficit_[*best])) {
+        best = i;
+      }
+    }
+    if (!best) {
+      best = 0;
+      for (std::size_t i = 1; i < kSmokerCount; ++i) {
+        if (deficit_[i] > deficit_[*best]) {
+          best = i;
+        }
+      }
+    }
+    deficit_[*best] -= 1.0;
+    return kAllSmokers[*best];
+  }
+
+ private:
+  std::array<double, kSmokerCount> deficit_{};
+};
+
+enum class AgentPolicy { kUniform, kRoundRobin, kLeastRecentlyServed, kWeightedDeficit };
+
+// политика из командной строки: uniform, round-robin, lrs, deficit
+inline std::optional<AgentPolicy> ParseAgentPolicy(std::string_view text) {
+  if (text == "uniform") {
+    return AgentPolicy::kUniform;
+  }
+  if (text == "round-robin") {
+    return AgentPolicy::kRoundRobin;
+  }
+  if (text == "lrs") {
+    return AgentPolicy::kLeastRecentlyServed;
+  }
+  if (text == "deficit") {
+    return AgentPolicy::kWeightedDeficit;
+  }
+  return std::nullopt;
+}
+
+constexpr std::string_view AgentPolicyName(AgentPolicy policy) {
+  switch (policy) {
+    case AgentPolicy::kUniform:
+      return "uniform";
+    case AgentPolicy::kRoundRobin:
+      return "round-robin";
+    case AgentPolicy::kLeastRecentlyServed:
+      return "lrs";
+    case AgentPolicy::kWeightedDeficit:
+      return "deficit";
+  }
+  return "uniform";
+}
+
+// политика, выбранная во время выполнения; сами политики - обычные классы, без виртуальных функций
+class AgentPicker {
+ public:
+  explicit AgentPicker(AgentPolicy policy = AgentPolicy::kUniform) {
+    switch (policy) {
+      case AgentPolicy::kUniform:
+        picker_.emplace<UniformPicker>();
+        break;
+      case AgentPolicy::kRoundRobin:
+        picker_.emplace<RoundRobinPicker>();
+        break;
+      case AgentPolicy::kLeastRecentlyServed:
+        picker_.emplace<LeastRecentlyServedPicker>();
+        break;
+      case AgentPolicy::kWeightedDeficit:
+        picker_.emplace<WeightedDeficitPicker>();
+        break;
+    }
+  }
+
+  // нужен ли выбранной политике AgentView; false - в next() можно отдавать пустой
+  bool usesView() const {
+    return std::visit([](const auto& picker) { return std::decay_t<decltype(picker)>::kUsesView; }, picker_);
+  }
+
+  template <typename Rng>
+  Ingredient next(Rng& rng, const AgentView& view) {
+    return std::visit([&](auto& picker) { return picker.next(rng, view); }, picker_);
+  }
+
+ private:
+  std::variant<UniformPicker, RoundRobinPicker, LeastRecentlyServedPicker, WeightedDeficitPicker> picker_{};
+};
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+#include "smoking_types.hpp"
+#include "smoking_padding.hpp"
+
+
+// тот же стол, что и SmokingTable, но без mutex и condition_variable
+// все состояние стола умещается в одно 32-битное слово:
+//   биты 0..2 - какие компоненты лежат на столе (бит IngredientIndex), 0 - стол пуст
+//   бит 3     - курит ли кто-то сейчас (smoker_busy_)
+//   бит 4     - пора сворачиваться (finished_)
+// каждый переход - одна CAS-операция, а ожидание - std::atomic::wait (на Linux это futex)
+class AtomicSmokingTable {
+ public:
+  // метод посредника, ждет пустого стола и свободных курильщиков, потом выкладывает пару
+  // false - стол закрыли или пара негодная (две одинаковые детали), как у SmokingTable
+  bool place(Ingredient first, Ingredient second) {
+    const std::uint32_t items = IngredientBit(first) | IngredientBit(second);
+    if (!IsPlaceableSet<kSmokerCount>(items)) {
+      return false;
+    }
+    std::uint32_t state = state_.load(std::memory_order_acquire);
+    while (true) {
+      if ((state & kFinished) != 0) {
+        return false;
+      }
+      if ((state & (kItemsMask | kBusy)) != 0) { // прошлый раунд еще идет, засыпаем до смены слова
+        state_.wait(state, std::memory_order_acquire);
+        state = state_.load(std::memory_order_acquire);
+        continue;
+      }
+      if (state_.compare_exchange_weak(state, state | items,
+                                       std::memory_order_acq_rel,
+                                       std::memory_order_acquire)) {
+        state_.notify_all(); // курильщики ждут на этом же слове
+        return true;
+      }
+      // CAS не прошел - в state уже лежит свежее значение, пробуем снова
+    }
+  }
+
+  // метод курильщика, ждет свою пару и забирает ее со стола одной CAS-операцией
+  bool startSmoking(Ingredient owned) {
+    const std::uint32_t own_bit = IngredientBit(owned);
+    std::uint32_t state = state_.load(std::memory_order_acquire);
+    while (true) {
+      if ((state & kFinished) != 0) {
+        return false;
+      }
+      const std::uint32_t items = state & kItemsMask;
+      if (items == 0 || (items & own_bit) != 0) { // пары нет или она не наша
+        state_.wait(state, std::memory_order_acquire);
+        state = state_.load(std::memory_order_acquire);
+        continue;
+      }
+      // стол очищаем и помечаем, что курильщик занят
+      // будить никого не нужно: посредник все равно ждет, пока курильщик докурит
+      if (state_.compare_exchange_weak(state, (state & ~kItemsMask) | kBusy,
+                                       std::memory_order_acq_rel,
+                                       std::memory_order_acquire)) {
+        return true;
+      }
+    }
+  }
+
+  // курильщик докурил
+  void finishSmoking() {
+    state_.fetch_and(~kBusy, std::memory_order_acq_rel);
+    state_.notify_all();
+  }
+
+  // посредник ждет конца текущего раунда
+  void waitForRoundEnd() {
+    std::uint32_t state = state_.load(std::memory_order_acquire);
+    while ((state & kFinished) == 0 && (state & (kItemsMask | kBusy)) != 0) {
+      state_.wait(state, std::memory_order_acquire);
+      state = state_.load(std::memory_order_acquire);
+    }
+  }
+
+  // выложить пару и дождаться конца раунда; здесь это просто place() + waitForRoundEnd():
+  // состояние - одно слово, и ждать отдельно "свой" раунд не нужно, он в полете всегда один
+  // false - стол закрыли раньше
+  bool runRound(Ingredient first, Ingredient second) {
+    if (!place(first, second)) {
+      return false;
+    }
+    waitForRoundEnd();
+    return (state_.load(std::memory_order_acquire) & kFinished) == 0;
+  }
+
+  // посредник сворачивает происходящее: стол пуст, никто не курит, все просыпаются
+  void finish() {
+    state_.store(kFinished, std::memory_order_release);
+    state_.notify_all();
+  }
+
+ private:
+  static constexpr std::uint32_t kItemsMask = 0b00111;
+  static constexpr std::uint32_t kBusy = 0b01000;
+  static constexpr std::uint32_t kFinished = 0b10000;
+
+  // все состояние стола; слово занимает строку кэша целиком, чтобы соседние объекты
+  // не попадали под каждую CAS курильщиков и посредника
+  alignas(kCacheLineSize) std::atomic<std::uint32_t> state_{0};
+};
@@ -0,0 +1,163 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <random>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <pthread.h>
+#include <sched.h>
+
+#include "smoking_types.hpp"
+#include "smoking_table.hpp"
+
+
+// кластер из K независимых столов: у каждого свой посредник и свои курильщики,
+// все потоки одного стола привязаны к одному ядру, столы раскладываются по ядрам по кругу
+// столы друг с другом ничего не делят, поэтому раунды/сек должны расти почти линейно с числом ядер
+
+// ядра, на которых процессу разрешено работать
+inline std::vector<int> AvailableCpus() {
+  std::vector<int> cpus;
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+      if (CPU_ISSET(cpu, &set)) {
+        cpus.push_back(cpu);
+      }
+    }
+  }
+  if (cpus.empty()) {
+    cpus.push_back(0);
+  }
+  return cpus;
+}
+
+// привязать вызывающий поток к ядру; false - ядро недоступно, поток остается где был
+// зовется первым делом в теле потока: привязка снаружи, после запуска, опаздывала бы -
+// поток успевал поработать со столом на чужом ядре
+inline bool PinCurrentThread(int cpu) {
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
+
+struct ClusterConfig {
+  std::size_t tables{1};
+  std::size_t smokers_per_type{1};
+  std::size_t depth{1}; // глубина конвейера каждого стола
+  std::uint64_t rounds_per_table{1000};
+  std::chrono::microseconds rolling{0}; // 0 - не спать, меряем чистую передачу пар
+  std::chrono::microseconds smoking{0};
+  std::vector<int> cpus{}; // на какие ядра раскладывать столы; пусто - все доступные
+  bool pin{true};          // false - не трогать привязку, пусть раскладывает планировщик
+  std::uint64_t seed{1};   // посредник стола i берет зерно seed + i
+};
+
+struct ClusterStats {
+  std::chrono::steady_clock::duration elapsed{};
+  std::uint64_t rounds{0};
+  // сигареты по столам и курильщикам: smoked_count[стол][i], курильщик i - тип i % kSmokerCount,
+  // номер i / kSmokerCount, как в main
+  std::vector<std::vector<std::uint64_t>> smoked_count;
+  std::array<std::uint64_t, kSmokerCount> smoked_by_type{}; // сводка по типам со всех столов
+
+  double roundsPerSecond() const {
+    const double seconds = std::chrono::duration<double>(elapsed).count();
+    return seconds > 0 ? static_cast<double>(rounds) / seconds : 0.0;
+  }
+};
+
+class TableCluster {
+ public:
+  explicit TableCluster(ClusterConfig config) : config_(std::move(config)) {
+    if (config_.cpus.empty()) {
+      config_.cpus = AvailableCpus();
+    }
+  }
+
+  // запускает все столы, ждет, пока каждый посредник проведет свои раунды, и сводит счетчики
+  ClusterStats run() {
+    const std::size_t worker_count = kSmokerCount * config_.smokers_per_type;
+
+    ClusterStats stats;
+    stats.smoked_count.assign(config_.tables, std::vector<std::uint64_t>(worker_count, 0));
+
+    std::vector<std::unique_ptr<SmokingTable>> tables;
+    for (std::size_t t = 0; t < config_.tables; ++t) {
+      tables.push_back(std::make_unique<SmokingTable>(config_.depth));
+    }
+
+    // курильщик считает в локальную переменную и пишет в stats один раз, на выходе,
+    // чтобы соседние счетчики разных потоков не делили строку кэша
+    // cpu - куда привязать поток до первой операции со столом; -1 - не привязывать
+    auto smoker_task = [this](SmokingTable& table, Ingredient ingredient, std::uint64_t& result, int cpu) {
+      if (cpu >= 0) {
+        PinCurrentThread(cpu);
+      }
+      std::uint64_t smoked = 0;
+      while (table.startSmoking(ingredient)) {
+        ++smoked;
+        if (config_.rolling.count() > 0) {
+          std::this_thread::sleep_for(config_.rolling);
+        }
+        if (config_.smoking.count() > 0) {
+          std::this_thread::sleep_for(config_.smoking);
+        }
+        table.finishSmoking();
+      }
+      result = smoked;
+    };
+
+    auto agent_task = [this](SmokingTable& table, std::uint64_t seed, int cpu) {
+      if (cpu >= 0) {
+        PinCurrentThread(cpu);
+      }
+      std::mt19937 rng(static_cast<std::mt19937::result_type>(seed));
+      std::uniform_int_distribution<std::size_t> dist(0, kSmokerCount - 1);
+      for (std::uint64_t round = 0; round < config_.rounds_per_table; ++round) {
+        const auto components = ComponentsFor(kAllSmokers[dist(rng)]);
+        table.place(components[0], components[1]);
+      }
+      table.waitForRoundEnd();
+      table.finish();
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(config_.tables * (worker_count + 1));
+    const auto start = std::chrono::steady_clock::now();
+    for (std::size_t t = 0; t < config_.tables; ++t) {
+      const int cpu = config_.pin ? config_.cpus[t % config_.cpus.size()] : -1;
+      for (std::size_t i = 0; i < worker_count; ++i) {
+        threads.emplace_back(smoker_task, std::ref(*tables[t]), kAllSmokers[i % kSmokerCount],
+                             std::ref(stats.smoked_count[t][i]), cpu);
+      }
+      threads.emplace_back(agent_task, std::ref(*tables[t]), config_.seed + t, cpu);
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+    stats.elapsed = std::chrono::steady_clock::now() - start;
+
+    for (const auto& table_counts : stats.smoked_count) {
+      for (std::size_t i = 0; i < table_counts.size(); ++i) {
+        stats.smoked_by_type[i % kSmokerCount] += table_counts[i];
+        stats.rounds += table_counts[i];
+      }
+    }
+    return stats;
+  }
+
+  const ClusterConfig& config() const { return config_; }
+
+ private:
+  ClusterConfig config_;
+};
@@ -0,0 +1,395 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cassert>
+#include <condition_variable>
+#include <coroutine>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "smoking_types.hpp"
+
+
+// корутинный вариант стола: посредники и курильщики - корутины C++20, а не потоки
+// пока корутина ждет, от нее остается только кадр (сотня байт), а не стек потока,
+// поэтому на паре потоков можно держать тысячи столов
+// осторожно: g++ 12 неверно собирает co_await прямо в условии while,
+// результат startSmoking() лучше сначала сохранить в переменную
+
+// исполнитель: по потоку на ядро, общая очередь готовых к продолжению корутин
+class CoroExecutor {
+ public:
+  explicit CoroExecutor(std::size_t threads = std::thread::hardware_concurrency()) {
+    if (threads == 0) {
+      threads = 1;
+    }
+    for (std::size_t i = 0; i < threads; ++i) {
+      workers_.emplace_back([this] { WorkerLoop(); });
+    }
+  }
+
+  CoroExecutor(const CoroExecutor&) = delete;
+  CoroExecutor& operator=(const CoroExecutor&) = delete;
+
+  ~CoroExecutor() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stopping_ = true;
+    }
+    ready_cv_.notify_all();
+    for (auto& worker : workers_) {
+      worker.join();
+    }
+  }
+
+  // поставить корутину в очередь на продолжение
+  void schedule(std::coroutine_handle<> handle) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      ready_.push_back(handle);
+    }
+    ready_cv_.notify_one();
+  }
+
+  // ждет, пока завершатся все запущенные через spawn() корутины
+  void waitIdle() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    idle_cv_.wait(lock, [this] { return active_tasks_ == 0; });
+  }
+
+  // корутина, запущенная на исполнителе; кадр удаляется сам по завершении
+  struct Task {
+    struct promise_type {
+      CoroExecutor* executor{nullptr};
+
+      Task get_return_object() {
+        return Task{std::coroutine_handle<promise_type>::from_promise(*this)};
+      }
+      std::suspend_always initial_suspend() noexcept { // стартует только после spawn()
+        return {};
+      }
+      auto final_suspend() noexcept {
+        struct Finalizer {
+          bool await_ready() noexcept { return false; }
+          void await_suspend(std::coroutine_handle<promise_type> handle) noexcept {
+            CoroExecutor* executor = handle.promise().executor;
+            handle.destroy();
+            executor->TaskDone();
+          }
+          void await_resume() noexcept {}
+        };
+        return Finalizer{};
+      }
+      void return_void() {}
+      void unhandled_exception() { std::terminate(); }
+    };
+
+    std::coroutine_handle<promise_type> handle;
+  };
+
+  void spawn(Task task) {
+    task.handle.promise().executor = this;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      ++active_tasks_;
+    }
+    schedule(task.handle);
+  }
+
+ private:
+  void TaskDone() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (--active_tasks_ == 0) {
+      idle_cv_.notify_all();
+    }
+  }
+
+  void WorkerLoop() {
+    while (true) {
+      std::coroutine_handle<> handle;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        ready_cv_.wait(lock, [this] { return stopping_ || !ready_.empty(); });
+        if (ready_.empty()) {
+          return; // stopping_ и работы больше нет
+        }
+        handle = ready_.front();
+        ready_.pop_front();
+      }
+      handle.resume();
+    }
+  }
+
+  std::mutex mutex_{};
+  std::condition_variable ready_cv_{};
+  std::condition_variable idle_cv_{};
+  std::deque<std::coroutine_handle<>> ready_{};
+  std::size_t active_tasks_{0};
+  bool stopping_{false};
+  std::vector<std::thread> workers_{};
+};
+
+// стол с тем же протоколом, что BasicSmokingTable<N> (конвейер depth, пары забираются по порядку),
+// но place(), startSmoking() и waitForRoundEnd() - это co_await
+// ожидающие хранятся в интрузивных списках прямо в кадрах корутин, памяти стол не выделяет
+// кто меняет состояние, тот сам выполняет операцию за ожидающего (кладет его пару, отдает пару курильщику)
+// и ставит его в очередь исполнителя - проснувшейся корутине ничего не нужно перепроверять
+template <std::size_t N>
+class BasicAsyncSmokingTable {
+  static_assert(N >= 2 && N <= kMaxIngredientCount,
+                "ингредиентов должно быть от 2 до 32, чтобы набор поместился в маску");
+
+  // общий заголовок всех ожидающих
+  struct Waiter {
+    Waiter* next{nullptr};
+    std::coroutine_handle<> handle{};
+    bool result{false}; // для startSmoking(): забрал ли пару, для place(): выложил ли набор
+  };
+
+  // очередь ожидающих в порядке прихода
+  struct WaiterList {
+    Waiter* head{nullptr};
+    Waiter* tail{nullptr};
+
+    bool empty() const { return head == nullptr; }
+
+    void push(Waiter* waiter) {
+      waiter->next = nullptr;
+      if (tail == nullptr) {
+        head = waiter;
+      } else {
+        tail->next = waiter;
+      }
+      tail = waiter;
+    }
+
+    Waiter* pop() {
+      Waiter* waiter = head;
+      head = waiter->next;
+      if (head == nullptr) {
+        tail = nullptr;
+      }
+      return waiter;
+    }
+
+    void append(WaiterList& other) {
+      while (!other.empty()) {
+        push(other.pop());
+      }
+    }
+  };
+
+ public:
+  explicit BasicAsyncSmokingTable(CoroExecutor& executor, std::size_t depth = 1)
+      : executor_(executor), depth_(depth), pending_(depth) {
+    assert(depth >= 1);
+  }
+
+  // co_await table.place(...) - выложить набор, дождавшись места в конвейере
+  // true - выложен; false - стол закрыли или набор негодный (IsPlaceableSet), как у SmokingTable
+  struct PlaceAwaiter : Waiter {
+    BasicAsyncSmokingTable& table;
+    IngredientMask items;
+
+    PlaceAwaiter(BasicAsyncSmokingTable& owner, IngredientMask placed) : table(owner), items(placed) {}
+
+    bool await_ready() const noexcept { return false; }
+
+    bool await_suspend(std::coroutine_handle<> handle) {
+      this->handle = handle;
+      if (!IsPlaceableSet<N>(items)) {
+        this->result = false;
+        return false;
+      }
+      WaiterList ready;
+      std::unique_lock<std::mutex> lock(table.mutex_);
+      if (table.finished_ || table.HasRoom()) {
+        this->result = !table.finished_;
+        if (!table.finished_) {
+          table.Push(items);
+          table.Dispatch(ready);
+        }
+        lock.unlock();
+        table.Resume(ready);
+        return false; // место было - не засыпаем
+      }
+      table.place_waiters_.push(this);
+      return true;
+    }
+
+    bool await_resume() const noexcept { return this->result; }
+  };
+
+  // co_await table.startSmoking(owned) - true, если пара забрана; false - стол закрыт
+  struct StartAwaiter : Waiter {
+    BasicAsyncSmokingTable& table;
+    Ingredient owned;
+
+    StartAwaiter(BasicAsyncSmokingTable& owner, Ingredient ingredient) : table(owner), owned(ingredient) {}
+
+    bool await_ready() const noexcept { return false; }
+
+    bool await_suspend(std::coroutine_handle<> handle) {
+      this->handle = handle;
+      WaiterList ready;
+      std::unique_lock<std::mutex> lock(table.mutex_);
+      if (table.finished_) {
+        this->result = false;
+        return false;
+      }
+      if (table.CanTake(owned)) {
+        table.Take();
+        this->result = true;
+        table.Dispatch(ready); // следующая пара могла стать первой
+        lock.unlock();
+        table.Resume(ready);
+        return false;
+      }
+      table.smoker_waiters_[IngredientIndex(owned)].push(this);
+      return true;
+    }
+
+    bool await_resume() const noexcept { return this->result; }
+  };
+
+  // co_await table.waitForRoundEnd() - дождаться, пока докурят все выложенные раунды
+  struct RoundEndAwaiter : Waiter {
+    BasicAsyncSmokingTable& table;
+
+    explicit RoundEndAwaiter(BasicAsyncSmokingTable& owner) : table(owner) {}
+
+    bool await_ready() const noexcept { return false; }
+
+    bool await_suspend(std::coroutine_handle<> handle) {
+      this->handle = handle;
+      std::lock_guard<std::mutex> lock(table.mutex_);
+      if (table.finished_ || table.Drained()) {
+        return false;
+      }
+      table.round_end_waiters_.push(this);
+      return true;
+    }
+
+    void await_resume() const noexcept {}
+  };
+
+  PlaceAwaiter place(Ingredient first, Ingredient second) requires(N == 3) {
+    return PlaceAwaiter(*this, IngredientBit(first) | IngredientBit(second));
+  }
+
+  PlaceAwaiter place(IngredientMask items) {
+    return PlaceAwaiter(*this, items);
+  }
+
+  StartAwaiter startSmoking(Ingredient owned) {
+    return StartAwaiter(*this, owned);
+  }
+
+  RoundEndAwaiter waitForRoundEnd() {
+    return RoundEndAwaiter(*this);
+  }
+
+  // курильщик докурил; не ждет, поэтому обычная функция
+  void finishSmoking() {
+    WaiterList ready;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      assert(busy_count_ > 0 && "finishSmoking() без startSmoking()");
+      --busy_count_;
+      Dispatch(ready);
+    }
+    Resume(ready);
+  }
+
+  // закрыть стол: все ожидающие продолжаются, startSmoking() вернет false
+  void finish() {
+    WaiterList ready;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      finished_ = true;
+      pending_count_ = 0; // busy_count_ не обнуляем: курящие еще позовут finishSmoking()
+      ready.append(place_waiters_);
+      ready.append(round_end_waiters_);
+      for (auto& waiters : smoker_waiters_) {
+        ready.append(waiters);
+      }
+    }
+    Resume(ready);
+  }
+
+ private:
+  bool HasRoom() const { return pending_count_ + busy_count_ < depth_; }
+
+  bool Drained() const { return pending_count_ == 0 && busy_count_ == 0; }
+
+  bool CanTake(Ingredient owned) const {
+    const IngredientMask need = NeedMaskFor<N>(owned);
+    return pending_count_ > 0 && (pending_[head_] & need) == need;
+  }
+
+  void Push(IngredientMask items) {
+    pending_[(head_ + pending_count_) % depth_] = items;
+    ++pending_count_;
+  }
+
+  void Take() {
+    ++busy_count_;
+    head_ = (head_ + 1) % depth_;
+    --pending_count_;
+  }
+
+  // под мьютексом: продвигаем стол, пока можем сделать что-то за ожидающих
+  void Dispatch(WaiterList& ready) {
+    while (true) {
+      if (pending_count_ > 0) { // первая пара и свободный курильщик ее типа
+        const IngredientMask missing = kFullMask<N> & ~pending_[head_];
+        auto& waiters = smoker_waiters_[static_cast<std::size_t>(std::countr_zero(missing))];
+        if (!waiters.empty()) {
+          Waiter* smoker = waiters.pop();
+          Take();
+          smoker->result = true;
+          ready.push(smoker);
+          continue;
+        }
+      }
+      if (HasRoom() && !place_waiters_.empty()) { // место в конвейере и посредник с набором
+        auto* agent = static_cast<PlaceAwaiter*>(place_waiters_.pop());
+        Push(agent->items);
+        agent->result = true;
+        ready.push(agent);
+        continue;
+      }
+      break;
+    }
+    if (Drained()) {
+      ready.append(round_end_waiters_);
+    }
+  }
+
+  // уже без мьютекса: отдаем проснувшихся исполнителю
+  void Resume(WaiterList& ready) {
+    while (!ready.empty()) {
+      executor_.schedule(ready.pop()->handle);
+    }
+  }
+
+  CoroExecutor& executor_;
+  std::mutex mutex_{};
+  const std::size_t depth_;
+  std::vector<IngredientMask> pending_;
+  std::size_t head_{0};
+  std::size_t pending_count_{0};
+  std::size_t busy_count_{0};
+  bool finished_{false};
+  WaiterList place_waiters_{};
+  WaiterList round_end_waiters_{};
+  std::array<WaiterList, N> smoker_waiters_{};
+};
+
+using AsyncSmokingTable = BasicAsyncSmokingTable<kSmokerCount>;
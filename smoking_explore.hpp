@@ -0,0 +1,442 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include <ucontext.h>
+
+#include "smoking_types.hpp"
+#include "smoking_wait.hpp"
+#include "smoking_table.hpp"
+
+
+// перебор расписаний потоков вместо sleep_for в тестах
+// тесты со sleep_for ловят только те чередования, которые удалось подгадать паузами, и долго ждут;
+// здесь потоки сценария - это контексты ucontext на одном настоящем потоке, и в каждый момент работает
+// ровно один из них. переключаемся только в точках планирования:
+//   - ScheduleExplorer::Point() - перед каждой операцией стола (ее вставляет ScheduledTable),
+//   - ожидание в столе (политика ExploreWait вместо cv.wait),
+// а кто пойдет дальше, решает выбор (chooser): случайный (ExploreRandom) или полный перебор (ExploreAll)
+// полный перебор растет экспоненциально, поэтому он ограничен числом вытеснений: вытеснение - отдать ход
+// другому, когда текущий мог бы продолжать; почти все гонки находятся уже при двух (как в CHESS)
+//
+// ожидание моделируется честно: контекст, ушедший в pause(), снова может работать только после
+// notifyOne/notifyAll своей cv. поэтому потерянное пробуждение - это не зависший тест, а прогон,
+// в котором все живые контексты ждут (kDeadlock), и его расписание можно тут же повторить
+//
+// так исследуется любой стол с параметром WaitPolicy (BasicSmokingTable и все его псевдонимы);
+// столы на std::atomic::wait (AtomicSmokingTable, InventoryTable) так не управляются
+// брошенные прогоны (тупик, предел шагов) не раскручиваются: то, что лежало на стеках контекстов,
+// не разрушается - только для тестов
+
+class ScheduleExplorer {
+ public:
+  // выбор планировщика: из options > 1 вариантов вернуть номер [0, options)
+  using Chooser = std::function<std::size_t(std::size_t options)>;
+
+  // чем кончился один прогон
+  struct Run {
+    enum class Outcome { kCompleted, kDeadlock, kStepLimit };
+
+    Outcome outcome{Outcome::kCompleted};
+    std::size_t steps{0};                // сколько раз контекстам передавали ход
+    std::vector<std::uint32_t> choices{}; // сделанные выборы по порядку - по ним прогон повторяется
+    std::vector<std::uint32_t> widths{};  // из скольких вариантов был каждый выбор
+    std::size_t max_preemptions{0};       // с каким пределом вытеснений шли - повторять надо с тем же
+  };
+
+  static constexpr std::size_t kUnbounded = static_cast<std::size_t>(-1);
+
+  // max_preemptions - сколько вытеснений за прогон; дальше текущий контекст работает, пока сам не уснет
+  explicit ScheduleExplorer(std::size_t max_steps = 10000, std::size_t max_preemptions = kUnbounded,
+                            std::size_t stack_size = 256 * 1024)
+      : max_steps_(max_steps), max_preemptions_(max_preemptions), stack_size_(stack_size) {}
+
+  ScheduleExplorer(const ScheduleExplorer&) = delete;
+  ScheduleExplorer& operator=(const ScheduleExplorer&) = delete;
+
+  // один прогон: каждый actor - поток сценария; стеки переиспользуются от прогона к прогону
+  Run run(std::vector<std::function<void()>>& actors, const Chooser& choose) {
+    Run result;
+    result.max_preemptions = max_preemptions_;
+    while (stacks_.size() < actors.size()) {
+      stacks_.push_back(std::make_unique<char[]>(stack_size_));
+    }
+    contexts_.assign(actors.size(), Context{});
+    for (std::size_t i = 0; i < actors.size(); ++i) {
+      ucontext_t& context = contexts_[i].context;
+      getcontext(&context);
+      context.uc_stack.ss_sp = stacks_[i].get();
+      context.uc_stack.ss_size = stack_size_;
+      context.uc_link = nullptr; // контекст не возвращается из Trampoline, он сам отдает ход
+      makecontext(&context, &Trampoline, 0);
+    }
+    actors_ = &actors;
+    choose_ = &choose;
+    run_ = &result;
+    ScheduleExplorer* const previous = current_;
+    current_ = this;
+    std::size_t preemptions = 0;
+
+    while (true) {
+      runnable_.clear();
+      bool all_done = true;
+      for (std::size_t i = 0; i < contexts_.size(); ++i) {
+        const Context& context = contexts_[i];
+        all_done = all_done && context.state == State::kDone;
+        // ждущий со сроком может и не дождаться пробуждения - срок выйдет; это тоже вариант
+        if (context.state == State::kRunnable || (context.state == State::kWaiting && context.timed)) {
+          runnable_.push_back(i);
+        }
+      }
+      if (runnable_.empty()) {
+        result.outcome = all_done ? Run::Outcome::kCompleted : Run::Outcome::kDeadlock;
+        break;
+      }
+      if (result.steps >= max_steps_) {
+        result.outcome = Run::Outcome::kStepLimit; // кто-то крутится без конца
+        break;
+      }
+      // кто только что отдал ход и может продолжать - вариант 0, остальные варианты - вытеснения
+      const auto last = std::find(runnable_.begin(), runnable_.end(), current_context_);
+      const bool can_continue = result.steps > 0 && last != runnable_.end() &&
+                                contexts_[current_context_].state == State::kRunnable;
+      if (can_continue) {
+        std::rotate(runnable_.begin(), last, last + 1);
+      }
+      std::size_t choice = 0;
+      if (!can_continue || preemptions < max_preemptions_) {
+        choice = Choose(runnable_.size());
+        preemptions += can_continue && choice != 0 ? 1 : 0;
+      }
+      ++result.steps;
+      Resume(runnable_[choice]);
+    }
+
+    current_ = previous;
+    actors_ = nullptr;
+    choose_ = nullptr;
+    run_ = nullptr;
+    return result;
+  }
+
+  // исследователь, под которым работает текущий контекст; nullptr - обычный поток
+  static ScheduleExplorer* Current() {
+    return current_;
+  }
+
+  // точка планирования: отдать ход, дальше может пойти кто угодно (в том числе мы же)
+  // вне исследователя ничего не делает
+  static void Point() {
+    if (ScheduleExplorer* const explorer = current_) {
+      explorer->Yield();
+    }
+  }
+
+  // ждать на cv до notify (timed - или до "срока", который наступает по выбору планировщика)
+  // на входе и на выходе lock захвачен, пока ждем - отпущен, как у cv.wait
+  void wait(std::condition_variable& cv, std::unique_lock<std::mutex>& lock, bool timed) {
+    Context& context = contexts_[current_context_];
+    context.state = State::kWaiting;
+    context.waiting_on = &cv;
+    context.timed = timed;
+    lock.unlock();
+    Yield();
+    lock.lock(); // мьютекс свободен: ход отдают только в Point() и здесь, оба раза без замка
+  }
+
+  // notify_one: если ждущих несколько, кого разбудить - тоже выбор планировщика
+  void notify(std::condition_variable& cv, bool all) {
+    waiters_.clear();
+    for (std::size_t i = 0; i < contexts_.size(); ++i) {
+      if (contexts_[i].state == State::kWaiting && contexts_[i].waiting_on == &cv) {
+        waiters_.push_back(i);
+      }
+    }
+    if (waiters_.empty()) {
+      return;
+    }
+    if (all) {
+      for (const std::size_t waiter : waiters_) {
+        Wake(contexts_[waiter]);
+      }
+    } else {
+      Wake(contexts_[waiters_[Choose(waiters_.size())]]);
+    }
+  }
+
+ private:
+  enum class State { kRunnable, kWaiting, kDone };
+
+  struct Context {
+    ucontext_t context{};
+    State state{State::kRunnable};
+    std::condition_variable* waiting_on{nullptr};
+    bool timed{false};
+  };
+
+  static void Trampoline() {
+    ScheduleExplorer* const explorer = current_;
+    const std::size_t index = explorer->current_context_;
+    (*explorer->actors_)[index]();
+    explorer->contexts_[index].state = State::kDone;
+    swapcontext(&explorer->contexts_[index].context, &explorer->scheduler_);
+  }
+
+  static void Wake(Context& context) {
+    context.state = State::kRunnable;
+    context.waiting_on = nullptr;
+  }
+
+  std::size_t Choose(std::size_t options) {
+    if (options <= 1) {
+      return 0; // без вариантов - не выбор, в расписание не пишем
+    }
+    const std::size_t choice = (*choose_)(options) % options;
+    run_->choices.push_back(static_cast<std::uint32_t>(choice));
+    run_->widths.push_back(static_cast<std::uint32_t>(options));
+    return choice;
+  }
+
+  void Resume(std::size_t index) {
+    Context& context = contexts_[index];
+    if (context.state == State::kWaiting) { // ждал со сроком и не дождался
+      Wake(context);
+    }
+    current_context_ = index;
+    swapcontext(&scheduler_, &context.context);
+  }
+
+  void Yield() {
+    swapcontext(&contexts_[current_context_].context, &scheduler_);
+  }
+
+  const std::size_t max_steps_;
+  const std::size_t max_preemptions_;
+  const std::size_t stack_size_;
+  std::vector<std::unique_ptr<char[]>> stacks_{};
+  std::vector<Context> contexts_{};
+  std::vector<std::size_t> runnable_{};
+  std::vector<std::size_t> waiters_{};
+  ucontext_t scheduler_{};
+  std::size_t current_context_{0};
+  std::vector<std::function<void()>>* actors_{nullptr};
+  const Chooser* choose_{nullptr};
+  Run* run_{nullptr};
+
+  static inline thread_local ScheduleExplorer* current_{nullptr};
+};
+
+// политика ожидания для BasicSmokingTable под исследователем: вместо сна на cv - отдать ход,
+// пробуждения тоже идут через исследователя; вне исследователя - обычные cv.wait/notify
+struct ExploreWait {
+  static void pause(std::condition_variable& cv, std::unique_lock<std::mutex>& lock, std::size_t) {
+    if (ScheduleExplorer* const explorer = ScheduleExplorer::Current()) {
+      explorer->wait(cv, lock, false);
+    } else {
+      cv.wait(lock);
+    }
+  }
+
+  static void pauseUntil(std::condition_variable& cv, std::unique_lock<std::mutex>& lock, std::size_t,
+                         std::chrono::steady_clock::time_point deadline) {
+    if (ScheduleExplorer* const explorer = ScheduleExplorer::Current()) {
+      explorer->wait(cv, lock, true);
+    } else {
+      cv.wait_until(lock, deadline);
+    }
+  }
+
+  static void notifyOne(std::condition_variable& cv) {
+    if (ScheduleExplorer* const explorer = ScheduleExplorer::Current()) {
+      explorer->notify(cv, false);
+    } else {
+      cv.notify_one();
+    }
+  }
+
+  static void notifyAll(std::condition_variable& cv) {
+    if (ScheduleExplorer* const explorer = ScheduleExplorer::Current()) {
+      explorer->notify(cv, true);
+    } else {
+      cv.notify_all();
+    }
+  }
+};
+
+// стол, у которого перед каждой операцией стоит точка планирования:
+// между двумя операциями одного потока может вклиниться любой другой
+template <typename Table>
+class ScheduledTable {
+ public:
+  template <typename... Args>
+  explicit ScheduledTable(Args&&... args) : table_(std::forward<Args>(args)...) {}
+
+  template <typename... Args>
+  decltype(auto) place(Args&&... args) {
+    ScheduleExplorer::Point();
+    return table_.place(std::forward<Args>(args)...);
+  }
+
+  template <typename... Args>
+  decltype(auto) tryPlace(Args&&... args) {
+    ScheduleExplorer::Point();
+    return table_.tryPlace(std::forward<Args>(args)...);
+  }
+
+  template <typename... Args>
+  decltype(auto) runRound(Args&&... args) {
+    ScheduleExplorer::Point();
+    return table_.runRound(std::forward<Args>(args)...);
+  }
+
+  template <typename... Args>
+  decltype(auto) startSmoking(Args&&... args) {
+    ScheduleExplorer::Point();
+    return table_.startSmoking(std::forward<Args>(args)...);
+  }
+
+  template <typename... Args>
+  decltype(auto) startSmokingOrLeave(Args&&... args) {
+    ScheduleExplorer::Point();
+    return table_.startSmokingOrLeave(std::forward<Args>(args)...);
+  }
+
+  template <typename... Args>
+  decltype(auto) joinSmoker(Args&&... args) {
+    ScheduleExplorer::Point();
+    return table_.joinSmoker(std::forward<Args>(args)...);
+  }
+
+  template <typename... Args>
+  decltype(auto) tryStartSmoking(Args&&... args) {
+    ScheduleExplorer::Point();
+    return table_.tryStartSmoking(std::forward<Args>(args)...);
+  }
+
+  void finishSmoking() {
+    ScheduleExplorer::Point();
+    table_.finishSmoking();
+  }
+
+  template <typename... Args>
+  decltype(auto) waitForRoundEnd(Args&&... args) {
+    ScheduleExplorer::Point();
+    return table_.waitForRoundEnd(std::forward<Args>(args)...);
+  }
+
+  void finish() {
+    ScheduleExplorer::Point();
+    table_.finish();
+  }
+
+  Table& table() {
+    return table_;
+  }
+
+ private:
+  Table table_;
+};
+
+using ExploredSmokingTable = ScheduledTable<BasicSmokingTable<kSmokerCount, ExploreWait>>;
+
+// сценарий для перебора: make() на каждый прогон строит свежее состояние
+// check() - инварианты после прогона, который дошел до конца (тупик и предел шагов - провал и без нее)
+struct ExploreScenario {
+  std::vector<std::function<void()>> actors;
+  std::function<bool()> check{};
+};
+
+struct ExploreReport {
+  std::uint64_t schedules{0}; // сколько расписаний прогнали
+  std::uint64_t failures{0};  // в скольких - тупик, предел шагов или нарушенный инвариант
+  bool exhausted{false};      // ExploreAll перебрал все расписания, а не уперся в предел
+  std::optional<ScheduleExplorer::Run> first_failure{}; // его можно повторить через ReplayExplored
+};
+
+template <typename MakeScenario>
+ScheduleExplorer::Run RunExploreScenario(ScheduleExplorer& explorer, MakeScenario& make,
+                                         const ScheduleExplorer::Chooser& choose, ExploreReport& report) {
+  ExploreScenario scenario = make();
+  ScheduleExplorer::Run run = explorer.run(scenario.actors, choose);
+  const bool ok = run.outcome == ScheduleExplorer::Run::Outcome::kCompleted && (!scenario.check || scenario.check());
+  ++report.schedules;
+  if (!ok) {
+    ++report.failures;
+    if (!report.first_failure) {
+      report.first_failure = run;
+    }
+  }
+  return run;
+}
+
+// случайные расписания: на каждом выборе - равновероятный вариант; зерно делает перебор повторяемым
+template <typename MakeScenario>
+ExploreReport ExploreRandom(MakeScenario make, std::uint64_t schedules, std::uint64_t seed,
+                            std::size_t max_steps = 10000) {
+  ScheduleExplorer explorer(max_steps);
+  ExploreReport report;
+  std::mt19937_64 rng(seed);
+  const ScheduleExplorer::Chooser choose = [&rng](std::size_t options) {
+    return std::uniform_int_distribution<std::size_t>(0, options - 1)(rng);
+  };
+  while (report.schedules < schedules) {
+    RunExploreScenario(explorer, make, choose, report);
+  }
+  return report;
+}
+
+// все расписания по очереди (поиск в глубину по выборам), но не больше max_schedules
+// и не больше max_preemptions вытеснений в каждом; следующее расписание - прошлое, у которого последний выбор с неиспробованными вариантами сдвинут на один
+template <typename MakeScenario>
+ExploreReport ExploreAll(MakeScenario make, std::uint64_t max_schedules, std::size_t max_preemptions = 2,
+                         std::size_t max_steps = 10000) {
+  ScheduleExplorer explorer(max_steps, max_preemptions);
+  ExploreReport report;
+  std::vector<std::uint32_t> prefix;
+  std::size_t decision = 0;
+  const ScheduleExplorer::Chooser choose = [&](std::size_t) -> std::size_t {
+    const std::size_t choice = decision < prefix.size() ? prefix[decision] : 0;
+    ++decision;
+    return choice;
+  };
+  while (report.schedules < max_schedules) {
+    decision = 0;
+    const ScheduleExplorer::Run run = RunExploreScenario(explorer, make, choose, report);
+    std::size_t depth = run.choices.size();
+    while (depth > 0 && run.choices[depth - 1] + 1 >= run.widths[depth - 1]) {
+      --depth;
+    }
+    if (depth == 0) {
+      report.exhausted = true;
+      break;
+    }
+    prefix.assign(run.choices.begin(), run.choices.begin() + static_cast<std::ptrdiff_t>(depth));
+    ++prefix.back();
+  }
+  return report;
+}
+
+// повторить записанный прогон (например, first_failure) по его выборам; дальше записи - всегда первый вариант
+template <typename MakeScenario>
+ExploreReport ReplayExplored(MakeScenario make, const ScheduleExplorer::Run& recorded,
+                             std::size_t max_steps = 10000) {
+  ScheduleExplorer explorer(max_steps, recorded.max_preemptions);
+  ExploreReport report;
+  std::size_t decision = 0;
+  const ScheduleExplorer::Chooser choose = [&](std::size_t) -> std::size_t {
+    return decision < recorded.choices.size() ? recorded.choices[decision++] : 0;
+  };
+  RunExploreScenario(explorer, make, choose, report);
+  return report;
+}
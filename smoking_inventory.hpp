@@ -0,0 +1,160 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include "smoking_types.hpp"
+#include "smoking_padding.hpp"
+
+
+// стол-склад: вместо одного посредника с парой - по поставщику на каждый компонент
+// каждый поставщик добавляет единицы своего компонента, курильщик начинает, как только на складе
+// есть его пара (ComponentsFor); пары как таковой больше нет, есть только остатки
+//
+// все остатки лежат в одном 64-битном слове, по kFieldBits бит на компонент, плюс бит "пора сворачиваться"
+// поэтому и поставка, и захват пары - одна CAS:
+//   - курильщик вычитает обе единицы сразу, так что два курильщика не возьмут одну единицу,
+//     а половинку пары никто не заберет
+//   - поставщик ждет только когда его собственное поле заполнено до capacity; остальных это не держит
+// ожидание - std::atomic::wait на этом же слове, как в AtomicSmokingTable
+class InventoryTable {
+ public:
+  static constexpr std::size_t kFieldBits = 16;
+  static constexpr std::uint64_t kMaxCapacity = (std::uint64_t{1} << kFieldBits) - 1;
+
+  static_assert(kSmokerCount * kFieldBits < 64, "остатки и флаг должны уместиться в одно слово");
+
+  // capacity - сколько единиц одного компонента может лежать на складе; больше - поставщик ждет
+  explicit InventoryTable(std::uint64_t capacity = 16)
+      : capacity_(capacity == 0 ? 1 : (capacity > kMaxCapacity ? kMaxCapacity : capacity)) {}
+
+  // поставщик кладет одну единицу; false - стол закрыт
+  bool supply(Ingredient ingredient) {
+    const std::size_t shift = Shift(ingredient);
+    std::uint64_t state = state_.load(std::memory_order_acquire);
+    while (true) {
+      if ((state & kFinished) != 0) {
+        return false;
+      }
+      if (((state >> shift) & kFieldMask) >= capacity_) { // склад этого компонента полон
+        state_.wait(state, std::memory_order_acquire);
+        state = state_.load(std::memory_order_acquire);
+        continue;
+      }
+      if (state_.compare_exchange_weak(state, state + (std::uint64_t{1} << shift),
+                                       std::memory_order_acq_rel,
+                                       std::memory_order_acquire)) {
+        state_.notify_all(); // курильщик, которому не хватало именно этой единицы
+        return true;
+      }
+    }
+  }
+
+  // курильщик ждет, пока на складе будет его пара, и забирает обе единицы одной CAS
+  bool startSmoking(Ingredient owned) {
+    std::uint64_t state = state_.load(std::memory_order_acquire);
+    while (true) {
+      if ((state & kFinished) != 0) {
+        return false;
+      }
+      if (!HasPair(state, owned)) {
+        state_.wait(state, std::memory_order_acquire);
+        state = state_.load(std::memory_order_acquire);
+        continue;
+      }
+      if (Claim(state, owned)) {
+        return true;
+      }
+    }
+  }
+
+  // то же без ожидания: пары нет (или стол закрыт) - сразу false
+  bool tryStartSmoking(Ingredient owned) {
+    std::uint64_t state = state_.load(std::memory_order_acquire);
+    while ((state & kFinished) == 0 && HasPair(state, owned)) {
+      if (Claim(state, owned)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // курильщик докурил; склад это не трогает, только считает раунды
+  void finishSmoking() {
+    completed_rounds_.value.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  // все ждущие просыпаются и уходят; остатки остаются видны через available()
+  void finish() {
+    state_.fetch_or(kFinished, std::memory_order_acq_rel);
+    state_.notify_all();
+  }
+
+  std::uint64_t available(Ingredient ingredient) const {
+    return (state_.load(std::memory_order_acquire) >> Shift(ingredient)) & kFieldMask;
+  }
+
+  // может ли сейчас хоть один курильщик взять пару
+  bool anyPairAvailable() const {
+    const std::uint64_t state = state_.load(std::memory_order_acquire);
+    for (const Ingredient smoker : kAllSmokers) {
+      if (HasPair(state, smoker)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  std::uint64_t completedRounds() const {
+    return completed_rounds_.value.load(std::memory_order_relaxed);
+  }
+
+ private:
+  static constexpr std::uint64_t kFieldMask = kMaxCapacity;
+  static constexpr std::uint64_t kFinished = std::uint64_t{1} << 63;
+
+  static constexpr std::size_t Shift(Ingredient ingredient) {
+    return IngredientIndex(ingredient) * kFieldBits;
+  }
+
+  // по единице каждого компонента пары курильщика owned, уже сдвинутые на свои поля
+  static constexpr std::uint64_t PairUnits(Ingredient owned) {
+    std::uint64_t units = 0;
+    for (const Ingredient component : ComponentsFor<kSmokerCount>(owned)) {
+      units += std::uint64_t{1} << Shift(component);
+    }
+    return units;
+  }
+
+  static bool HasPair(std::uint64_t state, Ingredient owned) {
+    for (const Ingredient component : ComponentsFor<kSmokerCount>(owned)) {
+      if (((state >> Shift(component)) & kFieldMask) == 0) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // state - то, что мы видели; CAS не прошел - в state уже свежее значение
+  bool Claim(std::uint64_t& state, Ingredient owned) {
+    if (!state_.compare_exchange_weak(state, state - PairUnits(owned),
+                                      std::memory_order_acq_rel,
+                                      std::memory_order_acquire)) {
+      return false;
+    }
+    // будим только если какое-то поле было полным - значит, там может ждать поставщик
+    for (const Ingredient component : ComponentsFor<kSmokerCount>(owned)) {
+      if (((state >> Shift(component)) & kFieldMask) >= capacity_) {
+        state_.notify_all();
+        break;
+      }
+    }
+    return true;
+  }
+
+  const std::uint64_t capacity_;
+  // слово со всеми остатками - в своей строке кэша, как state_ у AtomicSmokingTable
+  alignas(kCacheLineSize) std::atomic<std::uint64_t> state_{0};
+  CachePadded<std::atomic<std::uint64_t>> completed_rounds_{};
+};
@@ -1,17 +1,342 @@
 #pragma once
 
-#include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
 #include <mutex>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "smoking_types.hpp"
 
 namespace {
 
-// ф-ия печатает каждое сообщение целиком и гарантирует, что без перемешивания логов от разных потоков
-// std::mutex& io_mutex — общий замок, один на всех, передаётся по ссылке (чтобы все пользовались одним и тем же замком)
-// std::lock_guard<std::mutex> lock(io_mutex); — «захватить замок» на время этой функции. При выходе из функции замок автоматически отпустится
-void PrintMessage(std::mutex& io_mutex, const std::string& message) {
-  std::lock_guard<std::mutex> lock(io_mutex);
-  std::cout << message << std::endl;
+// строка фиксированной емкости, живет на стеке
+// сообщения собираются в ней через <<, без единого выделения памяти; не влезло - обрезается
+template <std::size_t Capacity>
+class MessageBuffer {
+ public:
+  MessageBuffer& operator<<(std::string_view text) {
+    const std::size_t count = std::min(text.size(), Capacity - size_);
+    std::memcpy(data_.data() + size_, text.data(), count);
+    size_ += count;
+    return *this;
+  }
+
+  template <typename Integer>
+    requires std::is_integral_v<Integer>
+  MessageBuffer& operator<<(Integer value) {
+    const auto result = std::to_chars(data_.data() + size_, data_.data() + Capacity, value);
+    if (result.ec == std::errc{}) {
+      size_ = static_cast<std::size_t>(result.ptr - data_.data());
+    }
+    return *this;
+  }
+
+  // дробные числа - с двумя знаками после точки
+  MessageBuffer& operator<<(double value) {
+    const auto result = std::to_chars(data_.data() + size_, data_.data() + Capacity, value,
+                                      std::chars_format::fixed, 2);
+    if (result.ec == std::errc{}) {
+      size_ = static_cast<std::size_t>(result.ptr - data_.data());
+    }
+    return *this;
+  }
+
+  std::string_view view() const {
+    return {data_.data(), size_};
+  }
+
+  void clear() {
+    size_ = 0;
+  }
+
+ private:
+  std::array<char, Capacity> data_{};
+  std::size_t size_{0};
+};
+
+using LineBuffer = MessageBuffer<256>; // одна строка журнала
+using LabelBuffer = MessageBuffer<64>; // подпись курильщика с номером
+
+// сообщения о событиях раунда; формат тот же, что печатался раньше
+// подпись курильщика из пула: "курильщик с табаком #2"
+inline void FormatWorkerLabel(LabelBuffer& out, Ingredient smoker, std::size_t number) {
+  out << SmokerLabelView(smoker) << " #" << number;
+}
+
+inline void FormatAgentPlace(LineBuffer& out, Ingredient smoker, int round) {
+  const auto components = ComponentsFor(smoker);
+  out << "Посредник выкладывает " << IngredientToString(components[0]) << " и "
+      << IngredientToString(components[1]) << " для " << SmokerLabelView(smoker)
+      << ". Раунд #" << round << ".";
+}
+
+inline void FormatSmokerTake(LineBuffer& out, std::string_view label, Ingredient smoker) {
+  const auto components = ComponentsFor(smoker);
+  out << label << " забирает " << IngredientToString(components[0]) << " и "
+      << IngredientToString(components[1]) << ".";
 }
 
+inline void FormatSmokerRolled(LineBuffer& out, std::string_view label, int cigarette) {
+  out << label << " скрутил сигарету #" << cigarette << ".";
+}
+
+inline void FormatSmokerFinished(LineBuffer& out, std::string_view label, int cigarette) {
+  out << label << " докурил сигарету #" << cigarette << ".";
+}
+
+// асинхронный журнал вместо PrintMessage
+// раньше каждое сообщение шло через общий io_mutex и std::endl, т.е. все потоки по очереди ждали консоль
+// теперь у каждого потока свое кольцо байт (один пишет, один читает - блокировок нет),
+// а один фоновый поток-писатель забирает сообщения из всех колец и пишет их в файл большими кусками
+// порядок сообщений одного потока сохраняется; между потоками порядок не гарантируется
+class AsyncLogger {
+ public:
+  // что делать, если кольцо потока заполнено
+  enum class OverflowPolicy {
+    kBlock, // ждать, пока писатель освободит место
+    kDrop,  // выбросить сообщение и увеличить счетчик dropped()
+  };
+
+  explicit AsyncLogger(std::FILE* out = stdout,
+                       OverflowPolicy policy = OverflowPolicy::kBlock,
+                       std::size_t ring_bytes = 64 * 1024)
+      : out_(out), policy_(policy), ring_bytes_(RoundUpToPowerOfTwo(ring_bytes)),
+        id_(NextLoggerId()) {
+    write_buffer_.reserve(kWriteBufferBytes);
+    writer_ = std::thread([this] { WriterLoop(); });
+  }
+
+  AsyncLogger(const AsyncLogger&) = delete;
+  AsyncLogger& operator=(const AsyncLogger&) = delete;
+
+  // при остановке писатель дописывает все, что успели положить в кольца
+  ~AsyncLogger() {
+    stop_.store(true, std::memory_order_seq_cst);
+    WakeWriter();
+    writer_.join();
+  }
+
+  // кладет строку в кольцо текущего потока; перевод строки добавляет писатель
+  void log(std::string_view message) {
+    Ring& ring = LocalRing();
+    const std::size_t length = std::min(message.size(), ring_bytes_ - kHeaderBytes); // слишком длинное обрезаем
+    const std::size_t need = kHeaderBytes + length;
+
+    std::size_t head = ring.head.load(std::memory_order_relaxed); // пишем только мы
+    while (ring_bytes_ - (head - ring.tail.load(std::memory_order_acquire)) < need) {
+      if (policy_ == OverflowPolicy::kDrop) {
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        return;
+      }
+      WakeWriter();
+      std::this_thread::yield();
+    }
+
+    const auto header = static_cast<std::uint32_t>(length);
+    CopyIn(ring, head, reinterpret_cast<const char*>(&header), kHeaderBytes);
+    CopyIn(ring, head + kHeaderBytes, message.data(), length);
+    ring.head.store(head + need, std::memory_order_release); // публикуем сообщение писателю
+
+    std::atomic_thread_fence(std::memory_order_seq_cst); // парный забор - в WriterLoop перед сном
+    if (writer_sleeping_.load(std::memory_order_relaxed)) {
+      WakeWriter();
+    }
+  }
+
+  // блокирует, пока все сообщения, положенные до вызова, не будут записаны и сброшены в файл
+  void flush() {
+    const std::uint64_t ticket = flush_requested_.fetch_add(1, std::memory_order_seq_cst) + 1;
+    WakeWriter();
+    std::uint64_t done = flush_done_.load(std::memory_order_acquire);
+    while (done < ticket) {
+      flush_done_.wait(done, std::memory_order_acquire);
+      done = flush_done_.load(std::memory_order_acquire);
+    }
+  }
+
+  // сколько сообщений выброшено политикой kDrop
+  std::uint64_t dropped() const {
+    return dropped_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  static constexpr std::size_t kHeaderBytes = sizeof(std::uint32_t); // длина сообщения перед его байтами
+  static constexpr std::size_t kWriteBufferBytes = 64 * 1024; // порция, которой писатель пишет в файл
+
+  // кольцо одного потока: head двигает поток-автор, tail - писатель
+  // счетчики не заворачиваются, позиция в буфере - счетчик & (размер - 1)
+  struct Ring {
+    explicit Ring(std::size_t bytes) : data(new char[bytes]) {}
+
+    std::unique_ptr<char[]> data;
+    std::thread::id owner{std::this_thread::get_id()};
+    alignas(64) std::atomic<std::size_t> head{0};
+    alignas(64) std::atomic<std::size_t> tail{0};
+  };
+
+  static std::size_t RoundUpToPowerOfTwo(std::size_t bytes) {
+    std::size_t size = 256;
+    while (size < bytes) {
+      size *= 2;
+    }
+    return size;
+  }
+
+  static std::uint64_t NextLoggerId() {
+    static std::atomic<std::uint64_t> next_id{1};
+    return next_id.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  void CopyIn(Ring& ring, std::size_t position, const char* source, std::size_t size) const {
+    const std::size_t offset = position & (ring_bytes_ - 1);
+    const std::size_t first = std::min(size, ring_bytes_ - offset); // до конца буфера, остальное - с начала
+    std::memcpy(ring.data.get() + offset, source, first);
+    std::memcpy(ring.data.get(), source + first, size - first);
+  }
+
+  void CopyOut(const Ring& ring, std::size_t position, char* target, std::size_t size) const {
+    const std::size_t offset = position & (ring_bytes_ - 1);
+    const std::size_t first = std::min(size, ring_bytes_ - offset);
+    std::memcpy(target, ring.data.get() + offset, first);
+    std::memcpy(target + first, ring.data.get(), size - first);
+  }
+
+  // кольцо текущего потока; регистрация под мьютексом - только при первом сообщении потока
+  Ring& LocalRing() {
+    struct Cache {
+      std::uint64_t logger_id{0};
+      Ring* ring{nullptr};
+    };
+    thread_local Cache cache;
+    if (cache.logger_id == id_) {
+      return *cache.ring;
+    }
+
+    std::lock_guard<std::mutex> lock(rings_mutex_);
+    Ring* ring = nullptr;
+    for (const auto& existing : rings_) { // поток мог писать сюда раньше, а кэш заняли другим журналом
+      if (existing->owner == std::this_thread::get_id()) {
+        ring = existing.get();
+      }
+    }
+    if (ring == nullptr) {
+      rings_.push_back(std::make_unique<Ring>(ring_bytes_));
+      ring = rings_.back().get();
+    }
+    cache = {id_, ring};
+    return *ring;
+  }
+
+  void WakeWriter() {
+    wake_.fetch_add(1, std::memory_order_seq_cst);
+    wake_.notify_one();
+  }
+
+  // забирает все готовые сообщения из кольца в буфер записи
+  bool Drain(Ring& ring) {
+    const std::size_t head = ring.head.load(std::memory_order_acquire);
+    std::size_t tail = ring.tail.load(std::memory_order_relaxed);
+    if (tail == head) {
+      return false;
+    }
+    while (tail != head) {
+      std::uint32_t length = 0;
+      CopyOut(ring, tail, reinterpret_cast<char*>(&length), kHeaderBytes);
+      if (write_buffer_.size() + length + 1 > kWriteBufferBytes) {
+        WriteOut();
+      }
+      const std::size_t old_size = write_buffer_.size();
+      write_buffer_.resize(old_size + length);
+      CopyOut(ring, tail + kHeaderBytes, write_buffer_.data() + old_size, length);
+      write_buffer_.push_back('\n');
+      tail += kHeaderBytes + length;
+    }
+    ring.tail.store(tail, std::memory_order_release); // место свободно, автор может писать дальше
+    return true;
+  }
+
+  bool DrainAll() {
+    std::lock_guard<std::mutex> lock(rings_mutex_); // мешает только регистрации новых потоков
+    bool drained = false;
+    for (const auto& ring : rings_) {
+      drained = Drain(*ring) || drained;
+    }
+    return drained;
+  }
+
+  void WriteOut() {
+    if (!write_buffer_.empty()) {
+      std::fwrite(write_buffer_.data(), 1, write_buffer_.size(), out_);
+      write_buffer_.clear();
+    }
+  }
+
+  bool AnyPending() {
+    std::lock_guard<std::mutex> lock(rings_mutex_);
+    for (const auto& ring : rings_) {
+      if (ring->head.load(std::memory_order_acquire) !=
+          ring->tail.load(std::memory_order_relaxed)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void WriterLoop() {
+    while (true) {
+      const std::uint64_t flush_target = flush_requested_.load(std::memory_order_seq_cst);
+      const bool stopping = stop_.load(std::memory_order_seq_cst);
+      while (DrainAll()) {
+      }
+      WriteOut();
+      std::fflush(out_);
+      if (flush_done_.load(std::memory_order_relaxed) < flush_target) {
+        flush_done_.store(flush_target, std::memory_order_release);
+        flush_done_.notify_all();
+      }
+      if (stopping) {
+        return; // все, что было положено до остановки, уже записано
+      }
+
+      // засыпаем, но сначала объявляем об этом и еще раз проверяем кольца,
+      // чтобы не проспать сообщение, положенное между проверкой и сном
+      const std::uint64_t wake = wake_.load(std::memory_order_seq_cst);
+      writer_sleeping_.store(true, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      if (!AnyPending() && !stop_.load(std::memory_order_seq_cst) &&
+          flush_requested_.load(std::memory_order_seq_cst) == flush_target) {
+        wake_.wait(wake, std::memory_order_seq_cst);
+      }
+      writer_sleeping_.store(false, std::memory_order_relaxed);
+    }
+  }
+
+  std::FILE* out_;
+  const OverflowPolicy policy_;
+  const std::size_t ring_bytes_;
+  const std::uint64_t id_; // уникальный номер журнала, по нему поток находит свое кольцо в кэше
+
+  std::mutex rings_mutex_{}; // авторы берут его только при регистрации нового кольца
+  std::vector<std::unique_ptr<Ring>> rings_{};
+
+  std::vector<char> write_buffer_{}; // принадлежит писателю
+  std::atomic<std::uint64_t> dropped_{0};
+  std::atomic<std::uint64_t> flush_requested_{0};
+  std::atomic<std::uint64_t> flush_done_{0};
+  std::atomic<std::uint32_t> wake_{0}; // писатель спит на этом слове
+  std::atomic<bool> writer_sleeping_{false};
+  std::atomic<bool> stop_{false};
+  std::thread writer_{};
+};
+
 } // namespace
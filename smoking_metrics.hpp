@@ -0,0 +1,104 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+
+// метрики стола: сколько ждут в place(), startSmoking() и waitForRoundEnd(),
+// сколько раз курильщики просыпались и сколько из этих пробуждений были впустую
+// собираются, только если стол собран с -DSMOKING_TABLE_METRICS, иначе кода нет вообще
+// все счетчики - атомики с relaxed, snapshot() читает их без блокировок прямо на ходу
+
+// гистограмма времени ожидания: корзина i - от 2^i до 2^(i+1) нс, в корзине 0 - меньше 2 нс
+class WaitHistogram {
+ public:
+  static constexpr std::size_t kBuckets = 40; // 2^40 нс - это больше 18 минут
+
+  void record(std::chrono::nanoseconds wait) {
+    const auto ns = static_cast<std::uint64_t>(wait.count() > 0 ? wait.count() : 0);
+    std::size_t bucket = ns < 2 ? 0 : static_cast<std::size_t>(std::bit_width(ns)) - 1;
+    if (bucket >= kBuckets) {
+      bucket = kBuckets - 1;
+    }
+    buckets_[bucket].fetch_add(1, std::memory_order_relaxed);
+    total_ns_.fetch_add(ns, std::memory_order_relaxed);
+  }
+
+  struct Snapshot {
+    std::array<std::uint64_t, kBuckets> buckets{};
+    std::uint64_t count{0};
+    std::uint64_t total_ns{0};
+
+    // верхняя граница корзины, в которую попадает доля fraction всех ожиданий
+    std::uint64_t percentileNs(double fraction) const {
+      const auto target = static_cast<std::uint64_t>(fraction * static_cast<double>(count));
+      std::uint64_t seen = 0;
+      for (std::size_t i = 0; i < kBuckets; ++i) {
+        seen += buckets[i];
+        if (seen > target) {
+          return std::uint64_t{2} << i;
+        }
+      }
+      return count == 0 ? 0 : std::uint64_t{2} << (kBuckets - 1);
+    }
+  };
+
+  Snapshot snapshot() const {
+    Snapshot result;
+    for (std::size_t i = 0; i < kBuckets; ++i) {
+      result.buckets[i] = buckets_[i].load(std::memory_order_relaxed);
+      result.count += result.buckets[i];
+    }
+    result.total_ns = total_ns_.load(std::memory_order_relaxed);
+    return result;
+  }
+
+ private:
+  std::array<std::atomic<std::uint64_t>, kBuckets> buckets_{};
+  std::atomic<std::uint64_t> total_ns_{0};
+};
+
+// снимок всех метрик стола на N компонентов
+template <std::size_t N>
+struct TableMetricsSnapshot {
+  WaitHistogram::Snapshot place_wait;      // посредник ждет место в конвейере
+  WaitHistogram::Snapshot start_wait;      // курильщик ждет свою пару
+  WaitHistogram::Snapshot round_end_wait;  // посредник ждет конец раундов
+  WaitHistogram::Snapshot wake_latency;    // от notify до того, как разбуженный курильщик забрал пару
+  std::uint64_t smoker_wakeups{0};         // сколько раз курильщики просыпались в startSmoking()
+  std::uint64_t spurious_wakeups{0};       // из них впустую: предикат оказался ложным
+  std::uint64_t rounds_completed{0};       // вызовов finishSmoking()
+  std::array<std::uint64_t, N> rounds_taken{}; // раунды по компонентам, в момент, когда курильщик забрал пару
+};
+
+template <std::size_t N>
+class TableMetrics {
+ public:
+  WaitHistogram place_wait;
+  WaitHistogram start_wait;
+  WaitHistogram round_end_wait;
+  WaitHistogram wake_latency;
+  std::atomic<std::uint64_t> smoker_wakeups{0};
+  std::atomic<std::uint64_t> spurious_wakeups{0};
+  std::atomic<std::uint64_t> rounds_completed{0};
+  std::array<std::atomic<std::uint64_t>, N> rounds_taken{};
+
+  TableMetricsSnapshot<N> snapshot() const {
+    TableMetricsSnapshot<N> result;
+    result.place_wait = place_wait.snapshot();
+    result.start_wait = start_wait.snapshot();
+    result.round_end_wait = round_end_wait.snapshot();
+    result.wake_latency = wake_latency.snapshot();
+    result.smoker_wakeups = smoker_wakeups.load(std::memory_order_relaxed);
+    result.spurious_wakeups = spurious_wakeups.load(std::memory_order_relaxed);
+    result.rounds_completed = rounds_completed.load(std::memory_order_relaxed);
+    for (std::size_t i = 0; i < N; ++i) {
+      result.rounds_taken[i] = rounds_taken[i].load(std::memory_order_relaxed);
+    }
+    return result;
+  }
+};
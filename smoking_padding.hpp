@@ -0,0 +1,42 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+
+
+// раскладка по строкам кэша: то, что пишут разные потоки, не должно лежать в одной строке,
+// иначе ядра перекидывают строку друг другу на каждую запись (ложное разделение, false sharing)
+
+// 64 байта - строка кэша на x86-64 и большинстве ARM
+// std::hardware_destructive_interference_size не берем: g++ предупреждает, что в заголовке
+// ее значение может разойтись между единицами трансляции, собранными с разными -mtune
+constexpr std::size_t kCacheLineSize = 64;
+
+// значение, которое занимает целую строку кэша
+template <typename T>
+struct alignas(kCacheLineSize) CachePadded {
+  T value{};
+};
+
+// счетчики по курильщикам: каждый в своей строке кэша, поток пишет только в свой,
+// а сводятся они вместе только при чтении
+template <std::size_t Count, typename T = int>
+class PaddedCounters {
+ public:
+  T& operator[](std::size_t index) { return slots_[index].value; }
+  const T& operator[](std::size_t index) const { return slots_[index].value; }
+
+  constexpr std::size_t size() const { return Count; }
+
+  // сумма по всем счетчикам; для атомиков читает каждый по разу
+  auto total() const {
+    decltype(T{} + T{}) sum{};
+    for (const auto& slot : slots_) {
+      sum += slot.value;
+    }
+    return sum;
+  }
+
+ private:
+  std::array<CachePadded<T>, Count> slots_{};
+};
@@ -0,0 +1,348 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "smoking_types.hpp"
+#include "smoking_padding.hpp"
+
+
+// пул с перехватом работы (work stealing): по потоку на ядро, у каждого своя очередь задач
+// свою очередь поток разбирает с конца (последняя задача еще горячая в кэше),
+// а опустевший поток ворует у соседей с начала - самые старые задачи, так воры и хозяин реже сталкиваются
+// очереди - deque под своим мьютексом в своей строке кэша: мьютекс почти всегда свободен,
+// общим его делает только кража
+// задача - std::function; лямбда с захватом до двух указателей помещается в нее без выделения памяти
+// отложенные задачи (submitAfter) ждут своего срока у отдельного потока-таймера, а не в потоке пула:
+// пауза в работе - это не повод держать ядро
+class WorkStealingPool {
+ public:
+  explicit WorkStealingPool(std::size_t threads = std::thread::hardware_concurrency())
+      : queues_(threads == 0 ? 1 : threads), id_(NextPoolId()) {
+    for (std::size_t i = 0; i < queues_.size(); ++i) {
+      workers_.emplace_back([this, i] { WorkerLoop(i); });
+    }
+    timer_ = std::thread([this] { TimerLoop(); });
+  }
+
+  WorkStealingPool(const WorkStealingPool&) = delete;
+  WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+  // дорабатывает все, что успели отдать, и останавливает потоки
+  ~WorkStealingPool() {
+    waitIdle();
+    {
+      std::lock_guard<std::mutex> lock(sleep_mutex_);
+      stopping_ = true;
+    }
+    sleep_cv_.notify_all();
+    for (auto& worker : workers_) {
+      worker.join();
+    }
+    {
+      std::lock_guard<std::mutex> lock(timer_mutex_);
+      timer_stopping_ = true;
+    }
+    timer_cv_.notify_all();
+    timer_.join();
+  }
+
+  // задача из потока пула идет в его же очередь, снаружи - по кругу в очереди всех потоков
+  void submit(std::function<void()> task) {
+    outstanding_.fetch_add(1, std::memory_order_relaxed);
+    Enqueue(std::move(task));
+  }
+
+  // поставить задачу через delay: до срока она лежит у таймера, и ни один поток пула ею не занят
+  // waitIdle() ждет и такие задачи
+  void submitAfter(std::chrono::nanoseconds delay, std::function<void()> task) {
+    if (delay.count() <= 0) {
+      submit(std::move(task));
+      return;
+    }
+    outstanding_.fetch_add(1, std::memory_order_relaxed);
+    const auto due = std::chrono::steady_clock::now() + delay;
+    bool earliest = false;
+    {
+      std::lock_guard<std::mutex> lock(timer_mutex_);
+      earliest = timers_.empty() || due < timers_.begin()->first;
+      timers_.emplace(due, std::move(task));
+    }
+    if (earliest) { // таймер спит до более позднего срока - пусть пересчитает
+      timer_cv_.notify_one();
+    }
+  }
+
+  // ждет, пока не останется ни поставленных, ни выполняющихся задач
+  void waitIdle() {
+    std::unique_lock<std::mutex> lock(sleep_mutex_);
+    idle_cv_.wait(lock, [this] { return outstanding_.load(std::memory_order_acquire) == 0; });
+  }
+
+  std::size_t size() const {
+    return queues_.size();
+  }
+
+  // сколько задач выполнено не тем потоком, в чью очередь они попали
+  std::uint64_t stolen() const {
+    return stolen_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  struct Queue {
+    std::mutex mutex{};
+    std::deque<std::function<void()>> tasks{};
+  };
+
+  static std::uint64_t NextPoolId() {
+    static std::atomic<std::uint64_t> next_id{1};
+    return next_id.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  // задача, уже посчитанная в outstanding_, встает в очередь
+  void Enqueue(std::function<void()> task) {
+    const std::size_t index = CurrentWorker() < queues_.size()
+                                  ? CurrentWorker()
+                                  : next_queue_.fetch_add(1, std::memory_order_relaxed) % queues_.size();
+    {
+      std::lock_guard<std::mutex> lock(queues_[index].value.mutex);
+      queues_[index].value.tasks.push_back(std::move(task));
+    }
+    queued_.fetch_add(1, std::memory_order_seq_cst);
+    if (sleepers_.load(std::memory_order_seq_cst) > 0) { // парный порядок - в WorkerLoop перед сном
+      std::lock_guard<std::mutex> lock(sleep_mutex_);
+      sleep_cv_.notify_one();
+    }
+  }
+
+  // номер потока пула, в котором мы сейчас; не поток этого пула - size()
+  std::size_t CurrentWorker() const {
+    return worker_pool_ == id_ ? worker_index_ : queues_.size();
+  }
+
+  bool PopOwn(std::size_t index, std::function<void()>& task) {
+    Queue& queue = queues_[index].value;
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.tasks.empty()) {
+      return false;
+    }
+    task = std::move(queue.tasks.back());
+    queue.tasks.pop_back();
+    return true;
+  }
+
+  bool Steal(std::size_t thief, std::function<void()>& task) {
+    for (std::size_t offset = 1; offset < queues_.size(); ++offset) {
+      Queue& queue = queues_[(thief + offset) % queues_.size()].value;
+      std::lock_guard<std::mutex> lock(queue.mutex);
+      if (!queue.tasks.empty()) {
+        task = std::move(queue.tasks.front());
+        queue.tasks.pop_front();
+        stolen_.fetch_add(1, std::memory_order_relaxed);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void WorkerLoop(std::size_t index) {
+    worker_pool_ = id_;
+    worker_index_ = index;
+    std::function<void()> task;
+    while (true) {
+      if (PopOwn(index, task) || Steal(index, task)) {
+        queued_.fetch_sub(1, std::memory_order_relaxed);
+        task();
+        task = nullptr;
+        if (outstanding_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+          std::lock_guard<std::mutex> lock(sleep_mutex_);
+          idle_cv_.notify_all();
+        }
+        continue;
+      }
+      // засыпаем, но сначала объявляем об этом: submit() кладет задачу, потом смотрит sleepers_,
+      // а мы увеличиваем sleepers_, потом смотрим queued_ - кто-то из двоих увидит другого
+      std::unique_lock<std::mutex> lock(sleep_mutex_);
+      sleepers_.fetch_add(1, std::memory_order_seq_cst);
+      sleep_cv_.wait(lock, [this] {
+        return stopping_ || queued_.load(std::memory_order_seq_cst) > 0;
+      });
+      sleepers_.fetch_sub(1, std::memory_order_relaxed);
+      if (stopping_ && queued_.load(std::memory_order_seq_cst) == 0) {
+        return;
+      }
+    }
+  }
+
+  // таймер: спит до ближайшего срока и отдает созревшие задачи в очереди пула
+  void TimerLoop() {
+    std::unique_lock<std::mutex> lock(timer_mutex_);
+    while (!timer_stopping_) {
+      if (timers_.empty()) {
+        timer_cv_.wait(lock);
+        continue;
+      }
+      const auto first = timers_.begin();
+      if (std::chrono::steady_clock::now() < first->first) {
+        timer_cv_.wait_until(lock, first->first);
+        continue;
+      }
+      std::function<void()> task = std::move(first->second);
+      timers_.erase(first);
+      lock.unlock();
+      Enqueue(std::move(task));
+      lock.lock();
+    }
+  }
+
+  std::vector<CachePadded<Queue>> queues_;
+  const std::uint64_t id_;
+  std::vector<std::thread> workers_{};
+
+  std::atomic<std::uint64_t> outstanding_{0}; // поставлены и еще не выполнены (в очереди или в работе)
+  std::atomic<std::uint64_t> queued_{0};      // лежат в очередях
+  std::atomic<std::uint64_t> stolen_{0};
+  std::atomic<std::size_t> next_queue_{0};
+  std::atomic<std::size_t> sleepers_{0};
+  std::mutex sleep_mutex_{};
+  std::condition_variable sleep_cv_{};
+  std::condition_variable idle_cv_{};
+  bool stopping_{false};
+
+  std::thread timer_{};
+  std::mutex timer_mutex_{};
+  std::condition_variable timer_cv_{};
+  std::multimap<std::chrono::steady_clock::time_point, std::function<void()>> timers_{}; // по сроку
+  bool timer_stopping_{false};
+
+  static inline thread_local std::uint64_t worker_pool_{0};
+  static inline thread_local std::size_t worker_index_{0};
+};
+
+// курильщики поверх пула: вместо потока на курильщика - по диспетчеру на тип
+// у каждого типа smokers_per_type курильщиков, но это не потоки, а места: диспетчер ждет свободное место,
+// потом пару в startSmoking(), и отдает раунд задачей в пул - а сам сразу идет за следующей парой
+// раунд докурен, когда работа зовет round.done(): тогда finishSmoking(), и место снова свободно
+// работа может звать done() не сразу, а из другой задачи (например, поставленной через submitAfter()) -
+// так паузы раунда не держат потоки пула, и одновременно курят столько, сколько мест и глубина стола,
+// а не сколько в пуле ядер; простаивающее ядро подхватывает чужую очередь
+// work(round) - сама работа раунда; Table - любой стол со startSmoking()/finishSmoking()
+// (если у стола есть startSmokingRound(), раунд знает и свой номер на столе)
+template <typename Table>
+class PooledSmokers {
+ public:
+  // раунд в работе; done() - ровно один раз, из любого потока
+  struct Round {
+    PooledSmokers* owner;
+    Ingredient smoker;
+    std::size_t seat;                // номер курильщика своего типа, с 0
+    std::chrono::nanoseconds waited; // сколько этот курильщик ждал пару (от прошлого done() до startSmoking())
+    std::uint64_t number;            // номер раунда на столе (startSmokingRound()); 0 - стол его не сообщает
+
+    void done() const {
+      owner->Release(smoker, seat);
+    }
+  };
+
+  PooledSmokers(Table& table, WorkStealingPool& pool, std::size_t smokers_per_type,
+                std::function<void(const Round&)> work)
+      : table_(table), pool_(pool), work_(std::move(work)) {
+    const auto now = std::chrono::steady_clock::now();
+    for (auto& seats : seats_) {
+      for (std::size_t seat = smokers_per_type == 0 ? 1 : smokers_per_type; seat-- > 0;) {
+        seats.value.free.push_back(seat); // первым займут место 0
+      }
+      seats.value.free_since.assign(seats.value.free.size(), now);
+    }
+    for (const Ingredient smoker : kAllSmokers) {
+      dispatchers_.emplace_back([this, smoker] { Dispatch(smoker); });
+    }
+  }
+
+  PooledSmokers(const PooledSmokers&) = delete;
+  PooledSmokers& operator=(const PooledSmokers&) = delete;
+
+  ~PooledSmokers() {
+    join();
+  }
+
+  // дождаться диспетчеров (они выходят, когда стол закрыт) и всей отданной в пул работы
+  void join() {
+    for (auto& dispatcher : dispatchers_) {
+      if (dispatcher.joinable()) {
+        dispatcher.join();
+      }
+    }
+    pool_.waitIdle();
+  }
+
+  // сколько раундов начато каждым типом
+  std::uint64_t started(Ingredient smoker) const {
+    return started_[IngredientIndex(smoker)].load(std::memory_order_relaxed);
+  }
+
+ private:
+  // свободные места одного типа
+  struct Seats {
+    std::mutex mutex{};
+    std::condition_variable cv{};
+    std::vector<std::size_t> free{};
+    std::vector<std::chrono::steady_clock::time_point> free_since{}; // по номеру места: когда освободилось
+  };
+
+  void Dispatch(Ingredient smoker) {
+    Seats& seats = seats_[IngredientIndex(smoker)].value;
+    while (true) {
+      std::size_t seat = 0;
+      std::chrono::steady_clock::time_point free_since;
+      {
+        std::unique_lock<std::mutex> lock(seats.mutex);
+        seats.cv.wait(lock, [&seats] { return !seats.free.empty(); });
+        seat = seats.free.back();
+        seats.free.pop_back();
+        free_since = seats.free_since[seat];
+      }
+      std::uint64_t number = 0;
+      if constexpr (requires { table_.startSmokingRound(smoker); }) {
+        number = table_.startSmokingRound(smoker);
+        if (number == 0) {
+          return;
+        }
+      } else if (!table_.startSmoking(smoker)) {
+        return;
+      }
+      started_[IngredientIndex(smoker)].fetch_add(1, std::memory_order_relaxed);
+      const Round round{this, smoker, seat, std::chrono::steady_clock::now() - free_since, number};
+      pool_.submit([this, round] { work_(round); });
+    }
+  }
+
+  void Release(Ingredient smoker, std::size_t seat) {
+    table_.finishSmoking();
+    Seats& seats = seats_[IngredientIndex(smoker)].value;
+    {
+      std::lock_guard<std::mutex> lock(seats.mutex);
+      seats.free_since[seat] = std::chrono::steady_clock::now();
+      seats.free.push_back(seat);
+    }
+    seats.cv.notify_one();
+  }
+
+  Table& table_;
+  WorkStealingPool& pool_;
+  const std::function<void(const Round&)> work_;
+  std::array<CachePadded<Seats>, kSmokerCount> seats_{};
+  PaddedCounters<kSmokerCount, std::atomic<std::uint64_t>> started_{};
+  std::vector<std::thread> dispatchers_{};
+};
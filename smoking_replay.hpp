@@ -0,0 +1,248 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <optional>
+#include <span>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "smoking_types.hpp"
+
+
+// запись и повтор расписания посредника
+// посредник в обычном режиме берет зерно из std::random_device, и замеченную аномалию не повторить;
+// теперь можно записать, какие пары он выкладывал и сколько ждал каждый place(), а потом прогнать
+// ту же последовательность пар на другом столе (или другой его реализации) и сравнить раунд за раундом
+//
+// кроме ожидания в place() в записи есть и сам раунд: сколько он шел у курильщика от взятия пары
+// до finishSmoking() - этот замер делает курильщик, и по номеру раунда он сводится с записью посредника
+//
+// формат файла: заголовок ReplayFileHeader, дальше RoundRecord по 24 байта на раунд
+// число раундов в заголовок не пишем - его дает размер файла, так запись можно оборвать на любом раунде
+
+struct RoundRecord {
+  std::uint64_t started_ns; // когда посредник позвал place(), от начала прогона
+  std::uint32_t place_ns;   // сколько place() ждал места на столе (до ~4 с, больше - обрезается)
+  std::uint32_t smoke_ns;   // сколько раунд шел у курильщика, от взятия пары до finishSmoking(); 0 - не замерен
+  std::uint8_t smoker;      // IngredientIndex курильщика, которому пара
+  std::uint8_t reserved[7];
+};
+
+static_assert(sizeof(RoundRecord) == 24, "раунд в записи - 24 байта");
+
+struct ReplayFileHeader {
+  char magic[8]; // "SMKROUND"
+  std::uint32_t version;
+  std::uint32_t record_size;
+};
+
+constexpr char kReplayMagic[8] = {'S', 'M', 'K', 'R', 'O', 'U', 'N', 'D'};
+constexpr std::uint32_t kReplayVersion = 2; // 1 - без smoke_ns
+
+inline std::uint32_t ClampRecordNs(std::chrono::nanoseconds duration) {
+  return static_cast<std::uint32_t>(std::clamp<std::int64_t>(duration.count(), 0, UINT32_MAX));
+}
+
+// запись посредника; smoke_ns дописывается потом из замеров курильщиков (MergeRoundTimings)
+inline RoundRecord MakeRoundRecord(Ingredient smoker, std::chrono::nanoseconds started,
+                                   std::chrono::nanoseconds place_wait) {
+  return {static_cast<std::uint64_t>(started.count()), ClampRecordNs(place_wait), 0,
+          static_cast<std::uint8_t>(IngredientIndex(smoker)), {}};
+}
+
+// замер курильщика: номер раунда на столе (startSmokingRound(), с 1) и сколько раунд у него шел
+struct RoundTiming {
+  std::uint64_t round;
+  std::chrono::nanoseconds took;
+};
+
+// сводит замеры курильщиков с записью посредника: раунд n - это rounds[n - 1]
+// поэтому в rounds - только пары, которые стол принял (place() вернул true), как в ReplayRounds:
+// отвергнутая пара номера на столе не получает, и все замеры после нее съехали бы на соседний раунд
+// замеры раундов, которых в записи нет (посредник их не записал), пропускаются
+inline void MergeRoundTimings(std::span<RoundRecord> rounds, std::span<const RoundTiming> timings) {
+  for (const RoundTiming& timing : timings) {
+    if (timing.round >= 1 && timing.round <= rounds.size()) {
+      rounds[timing.round - 1].smoke_ns = ClampRecordNs(timing.took);
+    }
+  }
+}
+
+// пишет раунды в файл порциями; пишет один поток - посредник
+class RoundRecorder {
+ public:
+  explicit RoundRecorder(std::FILE* out) : out_(out) {
+    ReplayFileHeader header{};
+    std::memcpy(header.magic, kReplayMagic, sizeof(kReplayMagic));
+    header.version = kReplayVersion;
+    header.record_size = sizeof(RoundRecord);
+    std::fwrite(&header, sizeof(header), 1, out_);
+  }
+
+  RoundRecorder(const RoundRecorder&) = delete;
+  RoundRecorder& operator=(const RoundRecorder&) = delete;
+
+  ~RoundRecorder() {
+    flush();
+  }
+
+  void record(const RoundRecord& round) {
+    buffer_[size_++] = round;
+    if (size_ == buffer_.size()) {
+      flush();
+    }
+  }
+
+  void flush() {
+    std::fwrite(buffer_.data(), sizeof(RoundRecord), size_, out_);
+    size_ = 0;
+    std::fflush(out_);
+  }
+
+ private:
+  std::FILE* out_;
+  std::array<RoundRecord, 256> buffer_{};
+  std::size_t size_{0};
+};
+
+// запись, отображенная в память целиком: раунды читаются прямо со страниц файла, без копирования
+// Open() не принимает файл, в котором нет ни одного целого раунда (один заголовок или обрывок) -
+// повторять там нечего, и молча подменять повтор случайным посредником нельзя
+class ReplaySchedule {
+ public:
+  static std::optional<ReplaySchedule> Open(const std::string& path) {
+    const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+      return std::nullopt;
+    }
+    struct stat info{};
+    if (fstat(fd, &info) != 0 ||
+        static_cast<std::size_t>(info.st_size) < sizeof(ReplayFileHeader) + sizeof(RoundRecord)) {
+      close(fd);
+      return std::nullopt;
+    }
+    const auto size = static_cast<std::size_t>(info.st_size);
+    void* memory = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (memory == MAP_FAILED) {
+      return std::nullopt;
+    }
+    const auto* header = static_cast<const ReplayFileHeader*>(memory);
+    if (std::memcmp(header->magic, kReplayMagic, sizeof(kReplayMagic)) != 0 ||
+        header->version != kReplayVersion || header->record_size != sizeof(RoundRecord)) {
+      munmap(memory, size);
+      return std::nullopt;
+    }
+    madvise(memory, size, MADV_SEQUENTIAL); // читаем один раз от начала до конца
+    return ReplaySchedule(memory, size);
+  }
+
+  ReplaySchedule(ReplaySchedule&& other) noexcept
+      : memory_(std::exchange(other.memory_, nullptr)), size_(std::exchange(other.size_, 0)) {}
+
+  ReplaySchedule& operator=(ReplaySchedule&&) = delete;
+  ReplaySchedule(const ReplaySchedule&) = delete;
+  ReplaySchedule& operator=(const ReplaySchedule&) = delete;
+
+  ~ReplaySchedule() {
+    if (memory_ != nullptr) {
+      munmap(memory_, size_);
+    }
+  }
+
+  // недописанный хвост (оборванная запись) отбрасывается
+  std::span<const RoundRecord> rounds() const {
+    const auto* first = reinterpret_cast<const RoundRecord*>(static_cast<const char*>(memory_) +
+                                                             sizeof(ReplayFileHeader));
+    return {first, (size_ - sizeof(ReplayFileHeader)) / sizeof(RoundRecord)};
+  }
+
+ private:
+  ReplaySchedule(void* memory, std::size_t size) : memory_(memory), size_(size) {}
+
+  void* memory_;
+  std::size_t size_;
+};
+
+// посредник по записи: те же пары в том же порядке, без пауз между раундами
+// возвращает новые замеры по раундам (память под них выделяется до первого раунда);
+// smoke_ns в них пустые - их дописывают замеры курильщиков (MergeRoundTimings)
+// курильщиков запускает вызывающий; после последнего раунда ждем, пока все докурят
+// стол закрыли или он отверг пару - повтор обрывается, замеров меньше, чем раундов в записи
+template <typename Table>
+std::vector<RoundRecord> ReplayRounds(Table& table, std::span<const RoundRecord> schedule) {
+  std::vector<RoundRecord> replayed;
+  replayed.reserve(schedule.size());
+  const auto start = std::chrono::steady_clock::now();
+  for (const RoundRecord& round : schedule) {
+    const Ingredient smoker = kAllSmokers[round.smoker % kSmokerCount];
+    const auto components = ComponentsFor(smoker);
+    const auto started = std::chrono::steady_clock::now();
+    if (!table.place(components[0], components[1])) {
+      break;
+    }
+    replayed.push_back(MakeRoundRecord(smoker, started - start, std::chrono::steady_clock::now() - started));
+  }
+  table.waitForRoundEnd();
+  return replayed;
+}
+
+// сравнение двух прогонов одного расписания раунд за раундом
+struct ReplayComparison {
+  std::size_t rounds{0};          // сколько раундов сравнили (по короткому из двух)
+  std::size_t smoker_mismatches{0}; // раунды, где пары разные - значит, сравнивают разные расписания
+  std::chrono::nanoseconds baseline_place_total{0};
+  std::chrono::nanoseconds candidate_place_total{0};
+  std::chrono::nanoseconds max_place_slowdown{0}; // худший раунд: насколько дольше ждал place() у кандидата
+  std::size_t slowest_round{0};                   // его номер (с нуля)
+  // раунд у курильщика (smoke_ns) - только по раундам, замеренным в обоих прогонах
+  std::size_t smoked_rounds{0};
+  std::chrono::nanoseconds baseline_smoke_total{0};
+  std::chrono::nanoseconds candidate_smoke_total{0};
+  std::chrono::nanoseconds max_smoke_slowdown{0}; // худший раунд: насколько дольше он шел у кандидата
+  std::size_t slowest_smoke_round{0};             // его номер (с нуля)
+};
+
+inline ReplayComparison CompareReplays(std::span<const RoundRecord> baseline,
+                                       std::span<const RoundRecord> candidate) {
+  ReplayComparison comparison;
+  comparison.rounds = std::min(baseline.size(), candidate.size());
+  for (std::size_t i = 0; i < comparison.rounds; ++i) {
+    if (baseline[i].smoker != candidate[i].smoker) {
+      ++comparison.smoker_mismatches;
+    }
+    const std::chrono::nanoseconds before{baseline[i].place_ns};
+    const std::chrono::nanoseconds after{candidate[i].place_ns};
+    comparison.baseline_place_total += before;
+    comparison.candidate_place_total += after;
+    if (after - before > comparison.max_place_slowdown) {
+      comparison.max_place_slowdown = after - before;
+      comparison.slowest_round = i;
+    }
+    if (baseline[i].smoke_ns == 0 || candidate[i].smoke_ns == 0) {
+      continue;
+    }
+    ++comparison.smoked_rounds;
+    const std::chrono::nanoseconds smoked_before{baseline[i].smoke_ns};
+    const std::chrono::nanoseconds smoked_after{candidate[i].smoke_ns};
+    comparison.baseline_smoke_total += smoked_before;
+    comparison.candidate_smoke_total += smoked_after;
+    if (smoked_after - smoked_before > comparison.max_smoke_slowdown) {
+      comparison.max_smoke_slowdown = smoked_after - smoked_before;
+      comparison.slowest_smoke_round = i;
+    }
+  }
+  return comparison;
+}
@@ -0,0 +1,397 @@
+#pragma once
+
+#include <atomic>
+#include <cerrno>
+#include <climits>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <new>
+#include <optional>
+#include <string>
+#include <utility>
+
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "smoking_types.hpp"
+#include "smoking_padding.hpp"
+
+
+// стол в разделяемой памяти: посредник и курильщики могут быть разными процессами
+// протокол тот же, что у AtomicSmokingTable (одна пара, depth = 1), но:
+//   - состояние лежит в сегменте POSIX shm (shm_open + mmap), а не в объекте процесса
+//   - ждут через futex без FUTEX_PRIVATE_FLAG, то есть на физической странице, общей для процессов;
+//     std::mutex и std::condition_variable здесь не годятся - они не рассчитаны на разделение между процессами
+//   - вместо флага "курильщик занят" в слове лежит билет курильщика, забравшего пару: новый номер
+//     из общего счетчика на каждый захват. по билету finishSmoking() узнает свой раунд, так что
+//     потоки одного процесса друг за друга не докуривают; билет держит поток, который забрал пару
+//     (один поток - курильщик одного стола за раз)
+//   - рядом с билетом курильщик оставляет, кто он: pid и время запуска процесса. если этот процесс
+//     умер, не докурив, посредник замечает это и освобождает стол сам; pid, доставшийся потом
+//     другому процессу, за живого владельца не сойдет - у того другое время запуска
+//
+// слово состояния:
+//   биты 0..2  - компоненты на столе (бит IngredientIndex)
+//   бит 3      - пора сворачиваться
+//   биты 4..31 - билет курильщика, который курит сейчас (0 - никто)
+
+namespace shm_detail {
+
+// futex на слове в общей памяти: ждать, пока слово равно expected (не дольше timeout, nullptr - без срока)
+inline void FutexWait(std::atomic<std::uint32_t>& word, std::uint32_t expected, const timespec* timeout) {
+  syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&word), FUTEX_WAIT, expected, timeout, nullptr, 0);
+}
+
+inline void FutexWakeAll(std::atomic<std::uint32_t>& word) {
+  syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&word), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+}
+
+// что видно о процессе в /proc/pid/stat
+struct ProcessStat {
+  char state{'?'};           // R, S, Z, ...
+  std::uint64_t start_time{0}; // когда запущен, в тиках с загрузки системы
+};
+
+// false - /proc не прочитать (процесса нет или /proc не смонтирован)
+inline bool ReadProcessStat(pid_t pid, ProcessStat& stat) {
+  char path[32];
+  std::snprintf(path, sizeof(path), "/proc/%d/stat", static_cast<int>(pid));
+  const int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return false;
+  }
+  char text[512];
+  const ssize_t size = read(fd, text, sizeof(text) - 1);
+  close(fd);
+  if (size <= 0) {
+    return false;
+  }
+  text[size] = '\0';
+  // "pid (comm) S ppid ...": поля считаем от последней ')' - в comm могут быть и пробелы, и скобки
+  const char* field = nullptr;
+  for (const char* p = text; *p != '\0'; ++p) {
+    if (*p == ')') {
+      field = p;
+    }
+  }
+  if (field == nullptr || field[1] == '\0') {
+    return false;
+  }
+  stat.state = field[2];
+  // starttime - поле 22, то есть 19-е после состояния (поле 3)
+  for (int skipped = 0; skipped < 19 && field != nullptr; ++skipped) {
+    field = std::strchr(field + 2, ' ');
+  }
+  stat.start_time = field != nullptr ? std::strtoull(field + 1, nullptr, 10) : 0;
+  return true;
+}
+
+// время запуска текущего процесса; запоминаем на поток, но после fork() перечитываем - у ребенка оно свое
+inline std::uint64_t SelfStartTime() {
+  thread_local pid_t cached_pid = 0;
+  thread_local std::uint64_t cached_start = 0;
+  const pid_t self = getpid();
+  if (cached_pid != self) {
+    ProcessStat stat;
+    cached_start = ReadProcessStat(self, stat) ? stat.start_time : 0;
+    cached_pid = self;
+  }
+  return cached_start;
+}
+
+// жив ли тот самый процесс, что был запущен в start_time (0 - время неизвестно, проверяем только pid)
+// зомби (умер, но родитель еще не забрал код выхода) считается мертвым, как и чужой процесс с тем же pid
+inline bool ProcessAlive(pid_t pid, std::uint64_t start_time) {
+  if (kill(pid, 0) != 0 && errno == ESRCH) {
+    return false;
+  }
+  ProcessStat stat;
+  if (!ReadProcessStat(pid, stat)) {
+    return true; // нет /proc - верим kill()
+  }
+  return stat.state != 'Z' && (start_time == 0 || stat.start_time == 0 || stat.start_time == start_time);
+}
+
+} // namespace shm_detail
+
+class SharedSmokingTable {
+  static constexpr std::size_t kHolderSlots = 64; // сколько последних билетов помнят, кто их взял
+  // то, что лежит в общей памяти; только атомики, без указателей - адреса у процессов разные
+  // кто взял билет: пишется до захвата пары, билет - последним, так что совпавший билет
+  // при чтении означает, что pid и время запуска - того же захвата
+  struct Holder {
+    std::atomic<std::uint32_t> ticket;
+    std::atomic<std::int32_t> pid;
+    std::atomic<std::uint64_t> start_time;
+  };
+
+  struct Shared {
+    // пишется последним (release), когда весь заголовок уже готов; Open() читает его с acquire -
+    // совпал, значит, и остальной стол другой процесс видит уже инициализированным
+    std::atomic<std::uint64_t> magic;
+    alignas(kCacheLineSize) std::atomic<std::uint32_t> state;
+    std::atomic<std::uint32_t> waiters; // сколько процессов спят на state, чтобы не звать FUTEX_WAKE впустую
+    std::atomic<std::uint64_t> completed_rounds;
+    std::atomic<std::uint64_t> recovered_rounds; // раунды, брошенные умершими курильщиками
+    alignas(kCacheLineSize) std::atomic<std::uint32_t> next_ticket;
+    Holder holders[kHolderSlots]; // ячейка билета t - holders[t % kHolderSlots]
+  };
+
+  static_assert(std::atomic<std::uint32_t>::is_always_lock_free &&
+                    std::atomic<std::uint64_t>::is_always_lock_free,
+                "атомики в общей памяти должны быть без блокировок");
+  static_assert(sizeof(std::atomic<std::uint32_t>) == sizeof(std::uint32_t));
+
+ public:
+  // создать сегмент name (вида "/smoking") и стол в нем; сегмент удаляется, когда создатель уничтожает стол
+  // если сегмент с таким именем уже есть - nullopt: чужой работающий стол не трогаем;
+  // остатки упавшего прошлого запуска убирают явно, через Remove()
+  static std::optional<SharedSmokingTable> Create(const std::string& name) {
+    const int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0) {
+      return std::nullopt;
+    }
+    if (ftruncate(fd, sizeof(Shared)) != 0) {
+      close(fd);
+      shm_unlink(name.c_str());
+      return std::nullopt;
+    }
+    void* memory = mmap(nullptr, sizeof(Shared), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (memory == MAP_FAILED) {
+      shm_unlink(name.c_str());
+      return std::nullopt;
+    }
+    Shared* shared = new (memory) Shared{};
+    shared->magic.store(kMagic, std::memory_order_release);
+    return SharedSmokingTable(shared, name, true);
+  }
+
+  // удалить сегмент name; процессы, которые его уже отобразили, работают дальше, но новые его не откроют
+  static bool Remove(const std::string& name) {
+    return shm_unlink(name.c_str()) == 0;
+  }
+
+  // подключиться к столу, который создал другой процесс
+  // nullopt и для стола, который еще создается: между shm_open() и ftruncate() у Create() сегмент пустой,
+  // и чтение из такого отображения кончилось бы SIGBUS; а пока нет magic - заголовок еще не готов
+  static std::optional<SharedSmokingTable> Open(const std::string& name) {
+    const int fd = shm_open(name.c_str(), O_RDWR, 0600);
+    if (fd < 0) {
+      return std::nullopt;
+    }
+    struct stat info{};
+    if (fstat(fd, &info) != 0 || static_cast<std::size_t>(info.st_size) < sizeof(Shared)) {
+      close(fd);
+      return std::nullopt;
+    }
+    void* memory = mmap(nullptr, sizeof(Shared), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (memory == MAP_FAILED) {
+      return std::nullopt;
+    }
+    auto* shared = static_cast<Shared*>(memory);
+    if (shared->magic.load(std::memory_order_acquire) != kMagic) {
+      munmap(memory, sizeof(Shared));
+      return std::nullopt;
+    }
+    return SharedSmokingTable(shared, name, false);
+  }
+
+  SharedSmokingTable(SharedSmokingTable&& other) noexcept
+      : shared_(std::exchange(other.shared_, nullptr)),
+        name_(std::move(other.name_)),
+        owner_(std::exchange(other.owner_, false)) {}
+
+  SharedSmokingTable& operator=(SharedSmokingTable&&) = delete;
+  SharedSmokingTable(const SharedSmokingTable&) = delete;
+  SharedSmokingTable& operator=(const SharedSmokingTable&) = delete;
+
+  ~SharedSmokingTable() {
+    if (shared_ != nullptr) {
+      munmap(shared_, sizeof(Shared));
+      if (owner_) {
+        shm_unlink(name_.c_str());
+      }
+    }
+  }
+
+  // метод посредника: ждет пустого стола и свободных курильщиков, потом выкладывает пару
+  // false - стол закрыли или пара негодная (две одинаковые детали)
+  bool place(Ingredient first, Ingredient second) {
+    const std::uint32_t items = IngredientBit(first) | IngredientBit(second);
+    if (!IsPlaceableSet<kSmokerCount>(items)) {
+      return false;
+    }
+    std::uint32_t state = shared_->state.load(std::memory_order_acquire);
+    while (true) {
+      if ((state & kFinished) != 0) {
+        return false;
+      }
+      if ((state & (kItemsMask | kOwnerMask)) != 0) { // прошлый раунд еще идет
+        state = WaitForProgress(state);
+        continue;
+      }
+      if (shared_->state.compare_exchange_weak(state, state | items, std::memory_order_seq_cst)) {
+        Wake();
+        return true;
+      }
+    }
+  }
+
+  // метод курильщика: забирает свою пару одной CAS, записывая в слово новый билет
+  // билет остается у потока до finishSmoking()
+  bool startSmoking(Ingredient owned) {
+    const std::uint32_t own_bit = IngredientBit(owned);
+    std::uint32_t state = shared_->state.load(std::memory_order_acquire);
+    while (true) {
+      if ((state & kFinished) != 0) {
+        return false;
+      }
+      const std::uint32_t items = state & kItemsMask;
+      if (items == 0 || (items & own_bit) != 0) { // пары нет или она не наша
+        state = Sleep(state, nullptr);
+        continue;
+      }
+      // билет берем, только когда пара уже видна: ячейки холдеров идут по кругу, и билет,
+      // взятый заранее, мог бы дождаться, пока его ячейку перепишут
+      const std::uint32_t ticket = TakeTicket();
+      if (shared_->state.compare_exchange_strong(state, (state & ~kItemsMask) | (ticket << kOwnerShift),
+                                                 std::memory_order_seq_cst)) {
+        held_ticket_ = ticket;
+        return true;
+      }
+    }
+  }
+
+  // курильщик докурил; если посредник уже списал раунд (решил, что мы умерли), ничего не делаем
+  void finishSmoking() {
+    const std::uint32_t owner = std::exchange(held_ticket_, 0) << kOwnerShift;
+    if (owner == 0) {
+      return; // этот поток сейчас ничего не курит
+    }
+    std::uint32_t state = shared_->state.load(std::memory_order_acquire);
+    while ((state & kOwnerMask) == owner) {
+      if (shared_->state.compare_exchange_weak(state, state & ~kOwnerMask, std::memory_order_seq_cst)) {
+        shared_->completed_rounds.fetch_add(1, std::memory_order_relaxed);
+        Wake();
+        return;
+      }
+    }
+  }
+
+  // посредник ждет конца текущего раунда
+  void waitForRoundEnd() {
+    std::uint32_t state = shared_->state.load(std::memory_order_acquire);
+    while ((state & kFinished) == 0 && (state & (kItemsMask | kOwnerMask)) != 0) {
+      state = WaitForProgress(state);
+    }
+  }
+
+  bool runRound(Ingredient first, Ingredient second) {
+    if (!place(first, second)) {
+      return false;
+    }
+    waitForRoundEnd();
+    return (shared_->state.load(std::memory_order_acquire) & kFinished) == 0;
+  }
+
+  // стол закрыт для всех процессов сразу
+  void finish() {
+    shared_->state.store(kFinished, std::memory_order_seq_cst);
+    Wake();
+  }
+
+  std::uint64_t completedRounds() const {
+    return shared_->completed_rounds.load(std::memory_order_relaxed);
+  }
+
+  std::uint64_t recoveredRounds() const {
+    return shared_->recovered_rounds.load(std::memory_order_relaxed);
+  }
+
+ private:
+  static constexpr std::uint64_t kMagic = 0x534d4f4b; // "SMOK"
+  static constexpr std::uint32_t kItemsMask = 0b0111;
+  static constexpr std::uint32_t kFinished = 0b1000;
+  static constexpr std::uint32_t kOwnerShift = 4;
+  static constexpr std::uint32_t kOwnerMask = ~std::uint32_t{0} << kOwnerShift;
+  static constexpr std::uint32_t kMaxTicket = kOwnerMask >> kOwnerShift;
+  // как часто посредник, ждущий курильщика, проверяет, жив ли тот
+  static constexpr long kOwnerCheckNs = 50'000'000;
+
+  SharedSmokingTable(Shared* shared, std::string name, bool owner)
+      : shared_(shared), name_(std::move(name)), owner_(owner) {}
+
+  // заснуть, пока слово равно state; возвращает свежее значение
+  // waiters увеличиваем до FUTEX_WAIT: будящий сначала меняет слово, потом смотрит на waiters,
+  // а futex сам сверяет слово с expected, так что пробуждение не теряется
+  std::uint32_t Sleep(std::uint32_t state, const timespec* timeout) {
+    shared_->waiters.fetch_add(1, std::memory_order_seq_cst);
+    shm_detail::FutexWait(shared_->state, state, timeout);
+    shared_->waiters.fetch_sub(1, std::memory_order_relaxed);
+    return shared_->state.load(std::memory_order_acquire);
+  }
+
+  // новый билет (1..kMaxTicket, по кругу) и запись о том, кто его взял
+  std::uint32_t TakeTicket() {
+    const std::uint32_t ticket = shared_->next_ticket.fetch_add(1, std::memory_order_relaxed) % kMaxTicket + 1;
+    Holder& holder = shared_->holders[ticket % kHolderSlots];
+    holder.ticket.store(0, std::memory_order_relaxed);
+    holder.pid.store(static_cast<std::int32_t>(getpid()), std::memory_order_relaxed);
+    holder.start_time.store(shm_detail::SelfStartTime(), std::memory_order_relaxed);
+    holder.ticket.store(ticket, std::memory_order_release);
+    return ticket;
+  }
+
+  // умер ли процесс, взявший билет; если его ячейку уже переписали, не знаем - считаем живым
+  bool HolderDead(std::uint32_t ticket) const {
+    const Holder& holder = shared_->holders[ticket % kHolderSlots];
+    if (holder.ticket.load(std::memory_order_acquire) != ticket) {
+      return false;
+    }
+    const auto pid = static_cast<pid_t>(holder.pid.load(std::memory_order_relaxed));
+    const std::uint64_t start_time = holder.start_time.load(std::memory_order_relaxed);
+    if (holder.ticket.load(std::memory_order_acquire) != ticket) {
+      return false;
+    }
+    return !shm_detail::ProcessAlive(pid, start_time);
+  }
+
+  void Wake() {
+    if (shared_->waiters.load(std::memory_order_seq_cst) > 0) {
+      shm_detail::FutexWakeAll(shared_->state);
+    }
+  }
+
+  // посредник ждет, пока раунд сдвинется; если курильщик, держащий стол, умер - освобождает стол сам
+  std::uint32_t WaitForProgress(std::uint32_t state) {
+    const std::uint32_t owner = state & kOwnerMask;
+    if (owner != 0 && HolderDead(owner >> kOwnerShift)) {
+      if (shared_->state.compare_exchange_strong(state, state & ~kOwnerMask, std::memory_order_seq_cst)) {
+        shared_->recovered_rounds.fetch_add(1, std::memory_order_relaxed);
+        Wake();
+        return state & ~kOwnerMask;
+      }
+      return state; // слово уже поменялось - CAS положил в state свежее значение
+    }
+    // спим с таймаутом, даже если пару еще не забрали: курильщик заберет ее молча (посредника он не будит)
+    // и может умереть сразу после этого - тогда разбудить нас будет некому
+    const timespec timeout{0, kOwnerCheckNs};
+    return Sleep(state, &timeout);
+  }
+
+  Shared* shared_;
+  std::string name_;
+  bool owner_;
+  static inline thread_local std::uint32_t held_ticket_{0}; // билет раунда, который курит этот поток
+};
@@ -0,0 +1,238 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <optional>
+#include <queue>
+#include <random>
+#include <string_view>
+#include <vector>
+
+#include "smoking_types.hpp"
+#include "smoking_agent.hpp"
+
+
+// режим моделирования: тот же протокол стола (конвейер глубины depth, пулы курильщиков,
+// пары забираются по порядку), но вместо потоков и sleep_for - виртуальные часы и очередь событий
+// миллион раундов считается за доли секунды, поэтому можно изучать пропускную способность и справедливость
+
+using VirtualDuration = std::chrono::nanoseconds;
+
+// распределение длительности (скручивания или курения)
+struct DurationDistribution {
+  enum class Kind { kConstant, kUniform, kExponential };
+
+  Kind kind{Kind::kConstant};
+  VirtualDuration first{0};  // kConstant - значение, kUniform - минимум, kExponential - среднее
+  VirtualDuration second{0}; // kUniform - максимум
+
+  static DurationDistribution Constant(VirtualDuration value) {
+    return {Kind::kConstant, value, VirtualDuration{0}};
+  }
+
+  static DurationDistribution Uniform(VirtualDuration min, VirtualDuration max) {
+    return {Kind::kUniform, min, max};
+  }
+
+  static DurationDistribution Exponential(VirtualDuration mean) {
+    return {Kind::kExponential, mean, VirtualDuration{0}};
+  }
+
+  template <typename Rng>
+  VirtualDuration sample(Rng& rng) const {
+    switch (kind) {
+      case Kind::kConstant:
+        return first;
+      case Kind::kUniform: {
+        std::uniform_int_distribution<std::int64_t> dist(first.count(), second.count());
+        return VirtualDuration{dist(rng)};
+      }
+      case Kind::kExponential: {
+        if (first.count() == 0) { // exp:0 - нулевое среднее, интенсивность 1/0 распределению не отдать
+          return first;
+        }
+        std::exponential_distribution<double> dist(1.0 / static_cast<double>(first.count()));
+        return VirtualDuration{static_cast<std::int64_t>(dist(rng))};
+      }
+    }
+    return first;
+  }
+};
+
+// разбор строки вида const:300, uniform:100:500, exp:300 (миллисекунды)
+inline std::optional<DurationDistribution> ParseDurationDistribution(std::string_view text) {
+  auto parse_ms = [](std::string_view number) -> std::optional<VirtualDuration> {
+    double value = 0;
+    const auto result = std::from_chars(number.data(), number.data() + number.size(), value);
+    if (result.ec != std::errc{} || result.ptr != number.data() + number.size() || value < 0) {
+      return std::nullopt;
+    }
+    return VirtualDuration{static_cast<std::int64_t>(value * 1e6)};
+  };
+
+  const auto colon = text.find(':');
+  if (colon == std::string_view::npos) { // просто число - постоянная длительность
+    const auto value = parse_ms(text);
+    return value ? std::optional{DurationDistribution::Constant(*value)} : std::nullopt;
+  }
+  const std::string_view kind = text.substr(0, colon);
+  const std::string_view args = text.substr(colon + 1);
+  if (kind == "const") {
+    const auto value = parse_ms(args);
+    return value ? std::optional{DurationDistribution::Constant(*value)} : std::nullopt;
+  }
+  if (kind == "exp") {
+    const auto value = parse_ms(args);
+    return value ? std::optional{DurationDistribution::Exponential(*value)} : std::nullopt;
+  }
+  if (kind == "uniform") {
+    const auto second_colon = args.find(':');
+    if (second_colon == std::string_view::npos) {
+      return std::nullopt;
+    }
+    const auto min = parse_ms(args.substr(0, second_colon));
+    const auto max = parse_ms(args.substr(second_colon + 1));
+    if (!min || !max || *min > *max) {
+      return std::nullopt;
+    }
+    return DurationDistribution::Uniform(*min, *max);
+  }
+  return std::nullopt;
+}
+
+struct SimulationConfig {
+  std::uint64_t rounds{12};
+  std::size_t smokers_per_type{1};
+  std::size_t depth{1}; // как у SmokingTable: раундов в полете одновременно
+  DurationDistribution rolling{DurationDistribution::Constant(std::chrono::milliseconds(150))};
+  // у каждого типа курильщика свое распределение времени курения
+  std::array<DurationDistribution, kSmokerCount> smoking{
+      DurationDistribution::Constant(std::chrono::milliseconds(300)),
+      DurationDistribution::Constant(std::chrono::milliseconds(300)),
+      DurationDistribution::Constant(std::chrono::milliseconds(300))};
+  std::uint64_t seed{1};
+  AgentPolicy policy{AgentPolicy::kUniform}; // как посредник выбирает следующую пару
+};
+
+struct SimulationResult {
+  VirtualDuration elapsed{0}; // виртуальное время всего прогона
+  std::uint64_t rounds{0};
+  std::vector<std::uint64_t> smoked_count; // по курильщикам: тип i % kSmokerCount, номер i / kSmokerCount
+  std::vector<VirtualDuration> start_latency; // для каждого раунда: от place() до того, как пару забрали
+
+  double roundsPerSecond() const {
+    const double seconds = std::chrono::duration<double>(elapsed).count();
+    return seconds > 0 ? static_cast<double>(rounds) / seconds : 0.0;
+  }
+
+  // индекс справедливости Джейна по числу сигарет: 1 - все курили поровну, 1/n - курил один
+  double fairness() const {
+    double sum = 0;
+    double sum_of_squares = 0;
+    for (const auto count : smoked_count) {
+      sum += static_cast<double>(count);
+      sum_of_squares += static_cast<double>(count) * static_cast<double>(count);
+    }
+    return sum_of_squares > 0
+               ? sum * sum / (static_cast<double>(smoked_count.size()) * sum_of_squares)
+               : 1.0;
+  }
+
+  VirtualDuration latencyPercentile(double fraction) const {
+    if (start_latency.empty()) {
+      return VirtualDuration{0};
+    }
+    std::vector<VirtualDuration> sorted = start_latency;
+    const auto index = static_cast<std::size_t>(fraction * static_cast<double>(sorted.size() - 1));
+    std::nth_element(sorted.begin(), sorted.begin() + static_cast<std::ptrdiff_t>(index), sorted.end());
+    return sorted[index];
+  }
+};
+
+// дискретно-событийная модель стола
+inline SimulationResult RunSimulation(const SimulationConfig& config) {
+  std::mt19937_64 rng(config.seed);
+  AgentPicker picker(config.policy);
+  AgentView view;
+
+  const std::size_t worker_count = kSmokerCount * config.smokers_per_type;
+  SimulationResult result;
+  result.smoked_count.assign(worker_count, 0);
+  result.start_latency.reserve(static_cast<std::size_t>(config.rounds));
+
+  // свободные курильщики каждого типа (номера в smoked_count)
+  // в порядке очереди, как потоки на условной переменной
+  std::array<std::deque<std::size_t>, kSmokerCount> idle{};
+  for (std::size_t worker = 0; worker < worker_count; ++worker) {
+    idle[worker % kSmokerCount].push_back(worker);
+  }
+
+  struct Pending {
+    Ingredient smoker;
+    VirtualDuration placed_at;
+  };
+  std::deque<Pending> pending; // пары на столе по порядку
+
+  // событие - курильщик докурил
+  struct Finish {
+    VirtualDuration at;
+    std::size_t worker;
+    VirtualDuration work; // сколько длился раунд - для оценки view.service
+    bool operator>(const Finish& other) const {
+      return at > other.at || (at == other.at && worker > other.worker);
+    }
+  };
+  std::priority_queue<Finish, std::vector<Finish>, std::greater<>> events;
+
+  VirtualDuration now{0};
+  std::uint64_t placed = 0;
+  std::size_t busy = 0;
+
+  while (result.rounds < config.rounds) {
+    // посредник кладет пары, пока есть место в конвейере
+    while (placed < config.rounds && pending.size() + busy < config.depth) {
+      for (std::size_t type = 0; type < kSmokerCount; ++type) {
+        view.free[type] = idle[type].size();
+      }
+      for (const Pending& pair : pending) { // пары на столе уже обещаны свободным курильщикам
+        auto& free = view.free[IngredientIndex(pair.smoker)];
+        free -= free > 0 ? 1 : 0;
+      }
+      pending.push_back({picker.next(rng, view), now});
+      ++placed;
+    }
+    // свободные курильщики забирают пары с головы очереди
+    while (!pending.empty() && !idle[IngredientIndex(pending.front().smoker)].empty()) {
+      const Pending pair = pending.front();
+      pending.pop_front();
+      auto& free_workers = idle[IngredientIndex(pair.smoker)];
+      const std::size_t worker = free_workers.front();
+      free_workers.pop_front();
+      ++busy;
+      result.start_latency.push_back(now - pair.placed_at);
+      const VirtualDuration work =
+          config.rolling.sample(rng) + config.smoking[IngredientIndex(pair.smoker)].sample(rng);
+      events.push({now + work, worker, work});
+    }
+    // переводим часы на ближайшее событие
+    const Finish finish = events.top();
+    events.pop();
+    now = finish.at;
+    --busy;
+    ++result.smoked_count[finish.worker];
+    ++result.rounds;
+    idle[finish.worker % kSmokerCount].push_back(finish.worker);
+    // скользящее среднее с весом 1/8, как оценка RTT в TCP; первый замер берем как есть
+    auto& service = view.service[finish.worker % kSmokerCount];
+    service = service.count() == 0 ? finish.work : service + (finish.work - service) / 8;
+  }
+
+  result.elapsed = now;
+  return result;
+}
@@ -1,90 +1,581 @@
 #pragma once
 
+#include <algorithm>
 #include <array>
+#include <bit>
+#include <cassert>
+#include <chrono>
 #include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
 #include <mutex>
 #include <optional>
+#include <span>
+#include <stop_token>
+#include <type_traits>
+#include <vector>
 
 #include "smoking_types.hpp"
+#include "smoking_padding.hpp"
+#include "smoking_wait.hpp"
+#ifdef SMOKING_TABLE_METRICS
+#include "smoking_metrics.hpp"
+#endif
 
 
 // 4 потока круглого стола, или не круглого
 // стол, за которым сидят 3 курилбщика и 1 посредник
-class SmokingTable {
+// в общем виде - N курильщиков, по одному на компонент, а посредник кладет N - 1 компонентов;
+// число компонентов - параметр шаблона, таблицы масок считаются на этапе компиляции
+//
+// конвейерный режим: depth - сколько раундов может быть "в полете" одновременно
+// (лежат в очереди на столе + уже курятся). пары лежат в кольцевом буфере на depth мест,
+// курильщики забирают их строго по порядку, с головы очереди
+// depth = 1 (по умолчанию) - прежнее поведение: одна пара, и посредник ждет, пока ее докурят
+//
+// курильщиков одного типа может быть несколько (пул): любой свободный из них забирает подходящую пару,
+// а при depth > 1 несколько раундов курятся одновременно
+//
+// WaitPolicy - как ждать (см. smoking_wait.hpp): BlockingWait сразу спит на условной переменной,
+// SpinThenParkWait сначала крутится, YieldWait отдает квант; выбирается при компиляции
+template <std::size_t N, typename WaitPolicy = BlockingWait>
+class BasicSmokingTable {
+  static_assert(N >= 2 && N <= kMaxIngredientCount,
+                "ингредиентов должно быть от 2 до 32, чтобы набор поместился в маску");
+
  public:
+ explicit BasicSmokingTable(std::size_t depth = 1) : depth_(depth), pending_(depth) {
+    assert(depth >= 1);
+ }
+
  // метод посредника
- // он кладет на стол два компонента, но делает это только тогда, когда прошлый этап/раунд завершен
+ // он кладет на стол два компонента, но делает это только тогда, когда есть свободное место в конвейере
+ // (при depth = 1 - когда прошлый этап/раунд завершен)
  // на вход подаются две детали, которые порседник хочет выложить
- void place(Ingredient first, Ingredient second) {
+ // false - стол закрыли, набор негодный (две одинаковые детали) или на эластичном столе
+ // не осталось курильщиков этого типа (см. joinSmoker()); тогда ничего не выложено
+ bool place(Ingredient first, Ingredient second) requires(N == 3) {
+    return place(IngredientBit(first) | IngredientBit(second));
+ }
+
+ // то же самое для произвольного N: набор компонентов маской, ровно N - 1 бит
+ bool place(IngredientMask items) {
     std::unique_lock<std::mutex> lock(mutex_); // замок
-    table_cv_.wait(lock, [this] { // ждем, пока можно выложить два компонента, если условие истинно => не засыпаем
-        return finished_ || (!items_.has_value() && !smoker_busy_); // если ложно, отпускаем mutex_ и засыпаем, кто-то другой сможет изменить состояние и разбудить нас
-        // не вылетает из функции», а блокирует выполнение до тех пор, пока предикат не станет true
-        // после этого код продолжается на следующей строке после wait
-    });
-    if (finished_) { // прверяем на завершение процесс, если true, то выходим и ничего не выкладываем
-        return;
+    return PlaceLocked(lock, items, {}) != 0;
+ }
+
+ // варианты с ограничением ожидания; true - набор выложен,
+ // false - места так и не нашлось (сразу, к сроку, до отмены) или стол закрыли
+ // tryPlace() не ждет совсем, placeFor()/placeUntil() - не дольше срока,
+ // place(..., stop) - пока не попросят остановиться через stop_token; другие потоки стола это не трогает
+ bool tryPlace(IngredientMask items) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    return PlaceLocked(lock, items, WaitLimit{kNoWait, {}}) != 0;
+ }
+
+ template <typename Clock, typename Duration>
+ bool placeUntil(IngredientMask items, const std::chrono::time_point<Clock, Duration>& deadline) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    return PlaceLocked(lock, items, WaitLimit{ToSteady(deadline), {}}) != 0;
+ }
+
+ template <typename Rep, typename Period>
+ bool placeFor(IngredientMask items, const std::chrono::duration<Rep, Period>& timeout) {
+    return placeUntil(items, std::chrono::steady_clock::now() + timeout);
+ }
+
+ bool place(IngredientMask items, std::stop_token stop) {
+    std::stop_callback wake(stop, WakeOnStop{this, &table_cv_}); // до замка: при уже запрошенной остановке колбэк сработает сразу
+    std::unique_lock<std::mutex> lock(mutex_);
+    return PlaceLocked(lock, items, WaitLimit{std::nullopt, std::move(stop)}) != 0;
+ }
+
+ bool tryPlace(Ingredient first, Ingredient second) requires(N == 3) {
+    return tryPlace(IngredientBit(first) | IngredientBit(second));
+ }
+
+ template <typename Clock, typename Duration>
+ bool placeUntil(Ingredient first, Ingredient second,
+                 const std::chrono::time_point<Clock, Duration>& deadline) requires(N == 3) {
+    return placeUntil(IngredientBit(first) | IngredientBit(second), deadline);
+ }
+
+ template <typename Rep, typename Period>
+ bool placeFor(Ingredient first, Ingredient second,
+               const std::chrono::duration<Rep, Period>& timeout) requires(N == 3) {
+    return placeFor(IngredientBit(first) | IngredientBit(second), timeout);
+ }
+
+ bool place(Ingredient first, Ingredient second, std::stop_token stop) requires(N == 3) {
+    return place(IngredientBit(first) | IngredientBit(second), std::move(stop));
+ }
+
+ // посредник выкладывает пару и ждет, пока докурят этот раунд и все выложенные до него - один захват мьютекса на весь раунд
+ // прогресс считается номерами раундов: раунд seq считается докуренным, когда completed_rounds_ >= seq,
+ // а finishSmoking() будит посредника только тогда, когда докурен раунд, которого он ждет
+ // это счет докуренных раундов, а не отметка на каждом: верно, только пока посредник один -
+ // тогда после seq никто ничего не выложил, и seq докуренных - это ровно раунды 1..seq
+ // второй посредник (или чужой place() во время ожидания) - нарушение договора, его ловит assert
+ // false - стол закрыли раньше или пару не выложили (см. place())
+ bool runRound(Ingredient first, Ingredient second) requires(N == 3) {
+    return runRound(IngredientBit(first) | IngredientBit(second));
+ }
+
+ bool runRound(IngredientMask items) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    const std::uint64_t seq = PlaceLocked(lock, items, {});
+    if (seq == 0 || !WaitRoundLocked(lock, seq, {})) {
+      return false;
     }
-    items_.emplace(std::array<Ingredient, 2>{first, second}); // выкладываем на стол пару компонентов
-    smoker_cv_.notify_all(); // будим всех курильщиков, чтоб они могли компоненты забрать себе и начать курить
+    assert(placed_rounds_ == seq && "runRound() - только для единственного посредника");
+    return true;
+ }
+
+ // пачка раундов: выкладываем подряд, пока есть место в конвейере, и ждем только последний
+ // договор тот же, что у runRound(): посредник один
+ // возвращает, сколько раундов пачки докурено (меньше rounds.size(), если стол закрыли)
+ std::size_t runRounds(std::span<const std::array<Ingredient, 2>> rounds) requires(N == 3) {
+    return RunRounds(rounds, [](const std::array<Ingredient, 2>& pair) {
+      return IngredientBit(pair[0]) | IngredientBit(pair[1]);
+    });
+ }
+
+ std::size_t runRounds(std::span<const IngredientMask> rounds) {
+    return RunRounds(rounds, [](IngredientMask items) { return items; });
  }
 
  // метод курильщика
- // блокирует и ждет, пока на столе появится его пара компонентов, либо пока не придет сигнал завершения
- // если текущая пара - его,то он начинает курить, то есть он занят, стол им очищен и новый раунд начался
+ // блокирует и ждет, пока первой в очереди окажется его пара компонентов, либо пока не придет сигнал завершения
+ // если текущая пара - его,то он начинает курить, то есть он занят, пара снята со стола и новый раунд начался
  bool startSmoking(Ingredient owned) {
     std::unique_lock<std::mutex> lock(mutex_);
-    smoker_cv_.wait(lock, [this, owned] {
-      return finished_ || (items_.has_value() && Needs(owned, *items_));
-    });
-    if (finished_) {
-      return false; // если true, то курить не начинаем
+    return StartLocked(lock, owned, {});
+ }
+
+ // то же, но возвращает номер забранного раунда (как у place(): с 1, в порядке выкладки), 0 - стол закрыли
+ // пары забираются строго по очереди, так что номер - это сколько выложено минус сколько еще лежит
+ // по нему замер курильщика сводится с записью посредника (см. smoking_replay.hpp)
+ std::uint64_t startSmokingRound(Ingredient owned) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    return StartLocked(lock, owned, {}) ? placed_rounds_ - pending_count_ : 0;
+ }
+
+ // варианты с ограничением ожидания: false - пара так и не пришла (сразу, к сроку, до отмены)
+ // или стол закрыли; остальных курильщиков и посредника это не задевает
+ bool tryStartSmoking(Ingredient owned) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    return StartLocked(lock, owned, WaitLimit{kNoWait, {}});
+ }
+
+ template <typename Clock, typename Duration>
+ bool startSmokingUntil(Ingredient owned, const std::chrono::time_point<Clock, Duration>& deadline) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    return StartLocked(lock, owned, WaitLimit{ToSteady(deadline), {}});
+ }
+
+ template <typename Rep, typename Period>
+ bool startSmokingFor(Ingredient owned, const std::chrono::duration<Rep, Period>& timeout) {
+    return startSmokingUntil(owned, std::chrono::steady_clock::now() + timeout);
+ }
+
+ // stop_callback будит условную переменную этого типа курильщиков, поэтому отмена срабатывает сразу,
+ // а не когда кто-нибудь случайно разбудит поток
+ bool startSmoking(Ingredient owned, std::stop_token stop) {
+    std::stop_callback wake(stop, WakeOnStop{this, &smokers_[IngredientIndex(owned)].cv});
+    std::unique_lock<std::mutex> lock(mutex_);
+    return StartLocked(lock, owned, WaitLimit{std::nullopt, std::move(stop)});
+ }
+
+ // эластичный состав: курильщиков можно сажать за стол и снимать прямо на ходу, без finish()
+ // курильщик садится через joinSmoker() и дальше берет пары через startSmokingOrLeave(owned, stop)
+ // снять его - stop.request_stop(): раунд, который он курит, докуривается как обычно,
+ // а уходит он на следующем startSmokingOrLeave() (false) - с перерасчетом registeredSmokers()
+ // последний курильщик своего типа не уходит, пока на столе лежат пары для этого типа, - сначала докуривает их,
+ // иначе такая пара встала бы в голову очереди и заперла конвейер
+ // с первого joinSmoker() стол верит только составу: place() не выкладывает пару типу, у которого
+ // registeredSmokers() == 0, и возвращает false - проверка под тем же замком, что и уход курильщика,
+ // так что между "посредник увидел курильщика" и "пара легла на стол" тот уйти не успеет
+ // курильщики с обычным startSmoking() в состав не входят: на эластичном столе их пары отвергаются,
+ // поэтому все курильщики такого стола садятся через joinSmoker()
+ void joinSmoker(Ingredient owned) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    elastic_ = true;
+    SmokerSlot& slot = smokers_[IngredientIndex(owned)];
+    ++slot.registered;
+    if (slot.idle_count > 0) { // может, кто-то из этого типа ждет, чтобы уйти, и теперь ему есть на кого оставить пары
+      NotifyAll<WaitPolicy>(slot.cv);
     }
-    smoker_busy_ = true;
-    items_.reset();
-    lock.unlock(); // отпускаем мьютекс до уведомления
-    table_cv_.notify_all(); // стол пуст, курильщик занят, новый раунд
-    return true; // сигнал о начале раунда
-  }
-  
+ }
+
+ bool startSmokingOrLeave(Ingredient owned, std::stop_token stop) {
+    std::stop_callback wake(stop, WakeOnStop{this, &smokers_[IngredientIndex(owned)].cv});
+    std::unique_lock<std::mutex> lock(mutex_);
+    return StartLocked(lock, owned, {}, &stop);
+ }
+
+ // сколько курильщиков этого типа сидит за столом через joinSmoker()
+ std::size_t registeredSmokers(Ingredient smoker) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return smokers_[IngredientIndex(smoker)].registered;
+ }
+
   // курильщик докурил
   void finishSmoking() {
     std::lock_guard<std::mutex> lock(mutex_); // не нужно ничего ждать, не нужно вручную делать unlock
-    smoker_busy_ = false;
-    table_cv_.notify_all(); // будем всех ожидающих, прежде всего посредника, кот-ый либо в waitForRoundEnd(), либо в place() ждёт конца предыдущего раунда
+    assert(busy_count_ > 0 && "finishSmoking() без startSmoking()");
+    --busy_count_; // и после finish(): раунды, которые уже курились, докуриваются и считаются честно
+    ++completed_rounds_;
+#ifdef SMOKING_TABLE_METRICS
+    metrics_.rounds_completed.fetch_add(1, std::memory_order_relaxed);
+#endif
+    // будим посредника, только если он ждет места в конвейере (место только что освободилось)
+    // или ждет раунд, который как раз докурен; раньше тут был notify_all на каждый раунд
+    if (room_waiters_ > 0 || completed_rounds_ >= round_target_) {
+      round_target_ = kNoRoundTarget;
+      NotifyAll<WaitPolicy>(table_cv_); // ждущие еще не докуренного раунда сами выставят round_target_ заново
+    }
   }
-  
-  // посредник выложил два компонента, вызывает данную функцию и ждет конца текущего раунда перед тем, как объявить о завершении и переходить к следующему
+
+  // посредник выложил компоненты, вызывает данную функцию и ждет, пока докурят все выложенные раунды
+  // при depth = 1 это ровно конец текущего раунда
   void waitForRoundEnd() {
     std::unique_lock<std::mutex> lock(mutex_);
-    table_cv_.wait(lock, [this] {
-      return finished_ || (!items_.has_value() && !smoker_busy_);
-    });
+    WaitRoundLocked(lock, placed_rounds_, {}); // докурены все выложенные = докурен последний
   }
-  
+
+  // true - все выложенные раунды докурены, false - срок вышел, попросили остановиться или стол закрыли
+  template <typename Clock, typename Duration>
+  bool waitForRoundEndUntil(const std::chrono::time_point<Clock, Duration>& deadline) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    return WaitRoundLocked(lock, placed_rounds_, WaitLimit{ToSteady(deadline), {}});
+  }
+
+  template <typename Rep, typename Period>
+  bool waitForRoundEndFor(const std::chrono::duration<Rep, Period>& timeout) {
+    return waitForRoundEndUntil(std::chrono::steady_clock::now() + timeout);
+  }
+
+  bool waitForRoundEnd(std::stop_token stop) {
+    std::stop_callback wake(stop, WakeOnStop{this, &table_cv_});
+    std::unique_lock<std::mutex> lock(mutex_);
+    return WaitRoundLocked(lock, placed_rounds_, WaitLimit{std::nullopt, std::move(stop)});
+  }
+
+  // сколько курильщиков этого типа сейчас свободны и ждут свою пару
+  std::size_t idleSmokers(Ingredient smoker) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return smokers_[IngredientIndex(smoker)].idle_count;
+  }
+
+  // сколько пар для этого типа лежит на столе и еще не взято; свободные курильщики этого типа им уже обещаны,
+  // так что по-настоящему свободных - idleSmokers() минус это число
+  std::size_t pendingFor(Ingredient smoker) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return smokers_[IngredientIndex(smoker)].pending;
+  }
+
+  // свободные и обещанные сразу по всем типам, под одной блокировкой - для посредника, который смотрит
+  // на стол перед каждым раундом: раздельные idleSmokers()/pendingFor() брали бы мьютекс по разу на тип
+  // и вычитали бы друг из друга числа из разных моментов
+  struct SmokerCounts {
+    std::array<std::size_t, N> idle{};
+    std::array<std::size_t, N> pending{};
+
+    // свободные и еще никому не обещанные
+    std::size_t free(std::size_t type) const {
+      return idle[type] - std::min(idle[type], pending[type]);
+    }
+  };
+
+  SmokerCounts smokerCounts() const {
+    SmokerCounts counts;
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (std::size_t type = 0; type < N; ++type) {
+      counts.idle[type] = smokers_[type].idle_count;
+      counts.pending[type] = smokers_[type].pending;
+    }
+    return counts;
+  }
+
+#ifdef SMOKING_TABLE_METRICS
+  // снимок метрик; мьютекс не берется, можно звать на ходу из любого потока
+  TableMetricsSnapshot<N> snapshot() const {
+    return metrics_.snapshot();
+  }
+#endif
+
   // посредник сворачивает происходящее, все расходятся
   void finish() {
     std::lock_guard<std::mutex> lock(mutex_);
     finished_ = true;
-    items_.reset();
-    smoker_busy_ = false;
-    table_cv_.notify_all();
-    smoker_cv_.notify_all();
+    pending_count_ = 0; // невзятые пары пропадают, а busy_count_ не трогаем - курящие еще позовут finishSmoking()
+    NotifyAll<WaitPolicy>(table_cv_);
+    for (auto& smoker : smokers_) { // при завершении будим уже всех курильщиков
+      smoker.pending = 0;
+      NotifyAll<WaitPolicy>(smoker.cv);
+    }
   }
- 
+
  // подходит ли пара на столе курильщику
+ // одно И и одно сравнение с заранее посчитанной маской, от N не зависит
  private:
-  static bool Needs(Ingredient owned, const std::array<Ingredient, 2>& items) {
-    return items[0] != owned && items[1] != owned;
+  // где ждем - по этому выбирается гистограмма метрик
+  enum class WaitSite { kPlace, kStart, kRoundEnd };
+
+  static constexpr std::uint64_t kNoRoundTarget = std::numeric_limits<std::uint64_t>::max();
+
+  // сколько можно ждать: до срока и/или пока не попросят остановиться; {} - сколько понадобится
+  struct WaitLimit {
+    std::optional<std::chrono::steady_clock::time_point> deadline{};
+    std::stop_token stop{};
+  };
+
+  // срок, который уже прошел: try-варианты проверяют условие один раз и не ждут
+  static constexpr std::chrono::steady_clock::time_point kNoWait = std::chrono::steady_clock::time_point::min();
+
+  // чем закончилось ожидание
+  struct WaitOutcome {
+    bool ready{true};  // предикат стал истинным (а не вышел срок и не попросили остановиться)
+    bool slept{false}; // поток действительно ждал
+  };
+
+  // колбэк stop_token: будит тех, кто ждет на cv; под мьютексом, чтобы не проскочить
+  // между проверкой предиката и засыпанием
+  struct WakeOnStop {
+    BasicSmokingTable* table;
+    std::condition_variable* cv;
+    void operator()() const {
+      std::lock_guard<std::mutex> lock(table->mutex_);
+      NotifyAll<WaitPolicy>(*cv);
+    }
+  };
+
+  template <typename Clock, typename Duration>
+  static std::chrono::steady_clock::time_point ToSteady(
+      const std::chrono::time_point<Clock, Duration>& deadline) {
+    if constexpr (std::is_same_v<Clock, std::chrono::steady_clock>) {
+      return std::chrono::time_point_cast<std::chrono::steady_clock::duration>(deadline);
+    } else { // чужие часы переводим через "сколько осталось"
+      return std::chrono::steady_clock::now() +
+             std::chrono::duration_cast<std::chrono::steady_clock::duration>(deadline - Clock::now());
+    }
   }
 
-  std::mutex mutex_{}; // мьютекс: когда он захватывает поток, другие потоки ждут, пока он не совободится; любой доступ к общему состоянию стола выполняется под этим замком
-  // / условная переменная, своеобразный механизм, кот-ый успыляет поток до наступления опр. условия, а затем будит его сигналом
-  std::condition_variable table_cv_{}; // посредник ждет, пока курильщик накурится, то есть стол опустеет
-  std::condition_variable smoker_cv_{}; // посредник выложил пару компонентов и ему нужно пнуть курильщиков, чтоб кто-то курить начал
-  std::optional<std::array<Ingredient, 2>> items_{}; // либо стол пуст, либо на столе лежит пара компонентов
-  bool smoker_busy_{false}; // курит ли кто-то из курильщиков сейчас?
+  // под мьютексом: дождаться своей пары и забрать ее
+  // leave - курильщик из joinSmoker(): по этому stop_token он уходит из-за стола, если ему можно (CanLeave)
+  bool StartLocked(std::unique_lock<std::mutex>& lock, Ingredient owned, const WaitLimit& limit,
+                   const std::stop_token* leave = nullptr) {
+    const std::size_t index = IngredientIndex(owned);
+    ++smokers_[index].idle_count; // пока ждем - считаемся свободными
+    [[maybe_unused]] const WaitOutcome outcome = Wait(smokers_[index].cv, lock, WaitSite::kStart, [this, owned, index, leave] { // ждем на своей ячейке, а не на общей
+      return finished_ || (pending_count_ > 0 && Needs(owned, pending_[head_])) ||
+             (leave != nullptr && leave->stop_requested() && CanLeave(index));
+    }, limit);
+    --smokers_[index].idle_count;
+    // не дождались - просто уходим: предикат проверяется раньше срока и отмены,
+    // так что если нас будили под пару, мы ее забрали бы, и будить за нас коллегу не нужно
+    if (finished_ || !outcome.ready) {
+      if (leave != nullptr && finished_) { // стол закрыт - эластичный курильщик тоже уходит
+        --smokers_[index].registered;
+      }
+      return false; // если true, то курить не начинаем
+    }
+    if (!(pending_count_ > 0 && Needs(owned, pending_[head_]))) { // пары нет, а stop есть - уходим из-за стола
+      --smokers_[index].registered;
+      return false;
+    }
+#ifdef SMOKING_TABLE_METRICS
+    if (outcome.slept) { // сколько прошло от notify_one() до того, как курильщик реально проснулся
+      metrics_.wake_latency.record(std::chrono::steady_clock::now() - smokers_[index].notified_at);
+    }
+    metrics_.rounds_taken[index].fetch_add(1, std::memory_order_relaxed);
+#endif
+    ++busy_count_;
+    head_ = (head_ + 1) % depth_;
+    --pending_count_;
+    --smokers_[index].pending;
+    if (pending_count_ > 0) { // следующая пара стала первой - передаем эстафету ее курильщику (может, коллеге того же типа)
+      NotifySmokerFor(pending_[head_]);
+    }
+    // посредника не будим: раундов в полете столько же, а конец раунда еще не наступил
+    return true; // сигнал о начале раунда
+  }
+
+  // под мьютексом: дождаться места в конвейере и выложить набор
+  // возвращает номер раунда (с 1) или 0, если стол закрыли, ожидание кончилось по limit,
+  // набор негодный (IsPlaceableSet) - его не ждем и не выкладываем,
+  // или стол эластичный, а курильщиков этого типа за ним нет - состав смотрим уже после ожидания места
+  std::uint64_t PlaceLocked(std::unique_lock<std::mutex>& lock, IngredientMask items,
+                            const WaitLimit& limit) {
+    if (!IsPlaceableSet<N>(items)) {
+      return 0;
+    }
+    ++room_waiters_;
+    const WaitOutcome outcome = Wait(table_cv_, lock, WaitSite::kPlace, [this] { // ждем, пока можно выложить два компонента, если условие истинно => не засыпаем
+        return finished_ || pending_count_ + busy_count_ < depth_; // если ложно, отпускаем mutex_ и засыпаем, кто-то другой сможет изменить состояние и разбудить нас
+        // не вылетает из функции», а блокирует выполнение до тех пор, пока предикат не станет true
+        // после этого код продолжается на следующей строке после wait
+    }, limit);
+    --room_waiters_;
+    if (finished_ || !outcome.ready) { // прверяем на завершение процесс, если true, то выходим и ничего не выкладываем
+        return 0;
+    }
+    if (elastic_ && smokers_[SmokerFor(items)].registered == 0) { // пару некому брать - она заперла бы очередь
+        return 0;
+    }
+    pending_[(head_ + pending_count_) % depth_] = items; // кладем набор в хвост очереди
+    ++pending_count_;
+    ++smokers_[SmokerFor(items)].pending;
+    if (pending_count_ == 1) { // пара сразу оказалась первой - будим того, кому она нужна
+      NotifySmokerFor(pending_[head_]);
+    }
+    return ++placed_rounds_;
+  }
+
+  template <typename Rounds, typename ToMask>
+  std::size_t RunRounds(const Rounds& rounds, ToMask to_mask) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    const std::uint64_t before = placed_rounds_;
+    std::uint64_t last = before;
+    for (const auto& round : rounds) {
+      const std::uint64_t seq = PlaceLocked(lock, to_mask(round), {});
+      if (seq == 0) {
+        break;
+      }
+      last = seq;
+    }
+    if (WaitRoundLocked(lock, last, {})) {
+      assert(placed_rounds_ == last && "runRounds() - только для единственного посредника");
+    }
+    const std::uint64_t done = std::min(completed_rounds_, last);
+    return done > before ? static_cast<std::size_t>(done - before) : 0;
+  }
+
+  // под мьютексом: ждать, пока докурят раунд seq (а с ним и все раньше - посредник один, см. runRound())
+  // перед каждым засыпанием заявляем round_target_, чтобы finishSmoking() разбудил ровно к нему
+  bool WaitRoundLocked(std::unique_lock<std::mutex>& lock, std::uint64_t seq, const WaitLimit& limit) {
+    Wait(table_cv_, lock, WaitSite::kRoundEnd, [this, seq] {
+      if (finished_ || completed_rounds_ >= seq) {
+        return true;
+      }
+      round_target_ = std::min(round_target_, seq);
+      return false;
+    }, limit);
+    return !finished_ && completed_rounds_ >= seq;
+  }
+
+  // ждем по политике WaitPolicy, пока ready() не станет истинным, но не дольше limit
+  // предикат проверяется раньше срока и отмены: что успело случиться, то и засчитывается
+  // с метриками - еще замер времени ожидания и подсчет пробуждений (для спина - каждой проверки)
+  template <typename Predicate>
+  WaitOutcome Wait(std::condition_variable& cv, std::unique_lock<std::mutex>& lock,
+                   [[maybe_unused]] WaitSite site, Predicate ready, const WaitLimit& limit) {
+#ifdef SMOKING_TABLE_METRICS
+    const auto start = std::chrono::steady_clock::now();
+#endif
+    WaitOutcome outcome;
+    for (std::size_t attempt = 0; !ready(); ++attempt) {
+      if (limit.stop.stop_requested() ||
+          (limit.deadline && std::chrono::steady_clock::now() >= *limit.deadline)) {
+        outcome.ready = false;
+        break;
+      }
+#ifdef SMOKING_TABLE_METRICS
+      if (outcome.slept && site == WaitSite::kStart) {
+        metrics_.spurious_wakeups.fetch_add(1, std::memory_order_relaxed); // разбудили, а пара не наша
+      }
+#endif
+      if (limit.deadline) {
+        WaitPolicy::pauseUntil(cv, lock, attempt, *limit.deadline);
+      } else {
+        WaitPolicy::pause(cv, lock, attempt);
+      }
+      outcome.slept = true;
+#ifdef SMOKING_TABLE_METRICS
+      if (site == WaitSite::kStart) {
+        metrics_.smoker_wakeups.fetch_add(1, std::memory_order_relaxed);
+      }
+#endif
+    }
+#ifdef SMOKING_TABLE_METRICS
+    WaitHistogram& histogram = site == WaitSite::kPlace   ? metrics_.place_wait
+                               : site == WaitSite::kStart ? metrics_.start_wait
+                                                          : metrics_.round_end_wait;
+    histogram.record(std::chrono::steady_clock::now() - start);
+#endif
+    return outcome;
+  }
+
+  // уйти можно, если за столом остается коллега того же типа или на столе нет ни одной пары для этого типа
+  bool CanLeave(std::size_t index) const {
+    return smokers_[index].registered > 1 || smokers_[index].pending == 0;
+  }
+
+  // чей это набор: нужный курильщик - единственный бит, которого нет в наборе
+  static std::size_t SmokerFor(IngredientMask items) {
+    return static_cast<std::size_t>(std::countr_zero(kFullMask<N> & ~items));
+  }
+
+  static bool Needs(Ingredient owned, IngredientMask items) {
+    const IngredientMask need = NeedMaskFor<N>(owned);
+    return (items & need) == need;
+  }
+
+  // будим только того курильщика, которому эта пара подходит, остальные спят дальше
+  // раньше тут был notify_all: просыпались все трое и толкались за mutex_, хотя пара нужна одному
+  // из пула будим одного: пару все равно заберет кто-то один; если свободных нет - не будим никого,
+  // первый освободившийся сам увидит пару при следующем startSmoking()
+  void NotifySmokerFor(IngredientMask items) {
+    const std::size_t index = SmokerFor(items);
+    if (smokers_[index].idle_count > 0) {
+#ifdef SMOKING_TABLE_METRICS
+      smokers_[index].notified_at = std::chrono::steady_clock::now();
+#endif
+      NotifyOne<WaitPolicy>(smokers_[index].cv);
+    }
+  }
+
+  // у каждого типа курильщика своя ячейка в отдельной строке кэша: условная переменная,
+  // на которой ждут курильщики этого типа, и их счетчик
+  // раньше все N condition_variable и счетчики лежали вплотную, и ожидание одного типа
+  // гоняло строку кэша у соседнего
+  struct alignas(kCacheLineSize) SmokerSlot {
+    std::condition_variable cv{}; // будится только этот тип (индекс - IngredientIndex)
+    std::size_t idle_count{0}; // сколько курильщиков этого типа ждут в startSmoking()
+    std::size_t pending{0}; // сколько пар для этого типа лежит на столе
+    std::size_t registered{0}; // сколько их сидит за столом через joinSmoker() (эластичный состав)
+#ifdef SMOKING_TABLE_METRICS
+    std::chrono::steady_clock::time_point notified_at{}; // когда их будили в последний раз
+#endif
+  };
+
+  // общее состояние стола - одна строка вместе с мьютексом, под которым его и меняют
+  alignas(kCacheLineSize) mutable std::mutex mutex_{}; // мьютекс: когда он захватывает поток, другие потоки ждут, пока он не совободится; любой доступ к общему состоянию стола выполняется под этим замком
+  const std::size_t depth_; // глубина конвейера
+  std::vector<IngredientMask> pending_; // кольцевой буфер выложенных наборов
+  std::size_t head_{0}; // индекс первой пары в очереди
+  std::size_t pending_count_{0}; // сколько пар лежит на столе
+  std::size_t busy_count_{0}; // сколько курильщиков курит сейчас
   bool finished_{false}; // пора сворачиваться
+  bool elastic_{false}; // кто-то садился через joinSmoker(): пары выкладываем только типам из состава
+  std::uint64_t placed_rounds_{0}; // номер последнего выложенного раунда, только растет
+  std::uint64_t completed_rounds_{0}; // сколько раундов докурено, только растет
+  std::uint64_t round_target_{kNoRoundTarget}; // ближайший раунд, которого ждет посредник
+  std::size_t room_waiters_{0}; // сколько посредников ждут места в конвейере
+  // / условная переменная, своеобразный механизм, кот-ый успыляет поток до наступления опр. условия, а затем будит его сигналом
+  // у посредника своя строка: на ней ждет только он
+  alignas(kCacheLineSize) std::condition_variable table_cv_{}; // посредник ждет, пока курильщик накурится, то есть освободится место
+  // посредник выложил пару компонентов и ему нужно пнуть курильщика, чтоб тот начал курить
+  std::array<SmokerSlot, N> smokers_{};
+#ifdef SMOKING_TABLE_METRICS
+  TableMetrics<N> metrics_{};
+#endif
 };
 
+// классический стол на три компонента
+using SmokingTable = BasicSmokingTable<kSmokerCount>;
 
+// то же для коротких раундов, где пробуждение из ядра стоит дороже самого раунда
+using SpinningSmokingTable = BasicSmokingTable<kSmokerCount, SpinThenParkWait<>>;
+using YieldingSmokingTable = BasicSmokingTable<kSmokerCount, YieldWait>;
@@ -0,0 +1,272 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "smoking_types.hpp"
+
+
+// двоичная трасса событий раунда: кто, что и когда начал и закончил
+// текстовый журнал читать глазами долго, а по трассе в chrome://tracing или ui.perfetto.dev
+// сразу видно, кто кого ждал
+//
+// каждый поток пишет записи по 16 байт в свой буфер фиксированного размера (выделяется один раз,
+// при первом событии потока); заполнился - поток сам дописывает его в файл одним fwrite
+// формат файла: заголовок TraceFileHeader, дальше записи TraceRecord подряд, в порядке сброса буферов
+// в JSON для просмотрщика трассу переводит ConvertTraceToChromeJson (утилита trace2json)
+
+enum class TraceEvent : std::uint8_t {
+  kPlace,  // посредник кладет пару (вместе с ожиданием места на столе)
+  kTake,   // курильщик ждет и забирает пару
+  kRoll,   // курильщик скручивает
+  kSmoke,  // курильщик курит
+  kFinish, // курильщик отдает стол (finishSmoking)
+};
+
+// кто пишет событие: тип курильщика (IngredientIndex) или посредник
+constexpr std::uint8_t kTraceAgent = 3;
+
+struct TraceRecord {
+  std::uint64_t ns;     // от создания TraceRecorder
+  std::uint32_t arg;    // номер раунда у посредника, номер сигареты у курильщика
+  std::uint16_t thread; // номер потока в трассе, по порядку первого события
+  std::uint8_t kind;    // TraceEvent в младших битах, kTraceEnd - конец интервала
+  std::uint8_t who;     // IngredientIndex курильщика или kTraceAgent
+};
+
+static_assert(sizeof(TraceRecord) == 16, "запись трассы - 16 байт без выравнивающих дыр");
+
+constexpr std::uint8_t kTraceEnd = 0x80;
+
+struct TraceFileHeader {
+  char magic[8]; // "SMKTRACE"
+  std::uint32_t version;
+  std::uint32_t record_size;
+};
+
+constexpr char kTraceMagic[8] = {'S', 'M', 'K', 'T', 'R', 'A', 'C', 'E'};
+constexpr std::uint32_t kTraceVersion = 1;
+
+class TraceRecorder {
+ public:
+  // out == nullptr - трасса выключена, record() сразу возвращается
+  explicit TraceRecorder(std::FILE* out, std::size_t records_per_thread = 4096)
+      : out_(out), capacity_(records_per_thread == 0 ? 1 : records_per_thread), id_(NextRecorderId()) {
+    if (out_ != nullptr) {
+      TraceFileHeader header{};
+      std::memcpy(header.magic, kTraceMagic, sizeof(kTraceMagic));
+      header.version = kTraceVersion;
+      header.record_size = sizeof(TraceRecord);
+      std::fwrite(&header, sizeof(header), 1, out_);
+    }
+  }
+
+  TraceRecorder(const TraceRecorder&) = delete;
+  TraceRecorder& operator=(const TraceRecorder&) = delete;
+
+  ~TraceRecorder() {
+    flush();
+  }
+
+  bool enabled() const {
+    return out_ != nullptr;
+  }
+
+  void begin(TraceEvent event, std::uint8_t who, std::uint32_t arg) {
+    record(static_cast<std::uint8_t>(event), who, arg);
+  }
+
+  void end(TraceEvent event, std::uint8_t who, std::uint32_t arg) {
+    record(static_cast<std::uint8_t>(event) | kTraceEnd, who, arg);
+  }
+
+  // дописать в файл все буферы; звать, когда пишущие потоки уже остановились (например, после join)
+  void flush() {
+    if (out_ == nullptr) {
+      return;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto& buffer : buffers_) {
+      WriteLocked(*buffer);
+    }
+    std::fflush(out_);
+  }
+
+ private:
+  // буфер одного потока; пишет в него только владелец
+  struct Buffer {
+    Buffer(std::size_t capacity, std::uint16_t thread_number)
+        : records(new TraceRecord[capacity]), thread(thread_number) {}
+
+    std::unique_ptr<TraceRecord[]> records;
+    std::size_t size{0};
+    std::uint16_t thread;
+    std::thread::id owner{std::this_thread::get_id()};
+  };
+
+  static std::uint64_t NextRecorderId() {
+    static std::atomic<std::uint64_t> next_id{1};
+    return next_id.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  void record(std::uint8_t kind, std::uint8_t who, std::uint32_t arg) {
+    if (out_ == nullptr) {
+      return;
+    }
+    const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start_).count();
+    Buffer& buffer = LocalBuffer();
+    buffer.records[buffer.size++] = {static_cast<std::uint64_t>(ns), arg, buffer.thread, kind, who};
+    if (buffer.size == capacity_) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      WriteLocked(buffer);
+    }
+  }
+
+  void WriteLocked(Buffer& buffer) {
+    std::fwrite(buffer.records.get(), sizeof(TraceRecord), buffer.size, out_);
+    buffer.size = 0;
+  }
+
+  // буфер текущего потока - так же, как кольцо в AsyncLogger: кэш в thread_local, регистрация под мьютексом
+  Buffer& LocalBuffer() {
+    struct Cache {
+      std::uint64_t recorder_id{0};
+      Buffer* buffer{nullptr};
+    };
+    thread_local Cache cache;
+    if (cache.recorder_id == id_) {
+      return *cache.buffer;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    Buffer* buffer = nullptr;
+    for (const auto& existing : buffers_) {
+      if (existing->owner == std::this_thread::get_id()) {
+        buffer = existing.get();
+      }
+    }
+    if (buffer == nullptr) {
+      buffers_.push_back(std::make_unique<Buffer>(capacity_, static_cast<std::uint16_t>(buffers_.size())));
+      buffer = buffers_.back().get();
+    }
+    cache = {id_, buffer};
+    return *buffer;
+  }
+
+  std::FILE* out_;
+  const std::size_t capacity_;
+  const std::uint64_t id_;
+  const std::chrono::steady_clock::time_point start_{std::chrono::steady_clock::now()};
+
+  std::mutex mutex_{}; // файл и список буферов; в горячем пути берется только при сбросе полного буфера
+  std::vector<std::unique_ptr<Buffer>> buffers_{};
+};
+
+// интервал begin/end на время жизни объекта
+class TraceScope {
+ public:
+  TraceScope(TraceRecorder& recorder, TraceEvent event, std::uint8_t who, std::uint32_t arg)
+      : recorder_(recorder), event_(event), who_(who), arg_(arg) {
+    recorder_.begin(event_, who_, arg_);
+  }
+
+  TraceScope(const TraceScope&) = delete;
+  TraceScope& operator=(const TraceScope&) = delete;
+
+  ~TraceScope() {
+    recorder_.end(event_, who_, arg_);
+  }
+
+ private:
+  TraceRecorder& recorder_;
+  const TraceEvent event_;
+  const std::uint8_t who_;
+  const std::uint32_t arg_;
+};
+
+// прочитать трассу целиком; nullopt - не тот формат
+inline std::optional<std::vector<TraceRecord>> ReadTrace(std::FILE* in) {
+  TraceFileHeader header{};
+  if (std::fread(&header, sizeof(header), 1, in) != 1 ||
+      std::memcmp(header.magic, kTraceMagic, sizeof(kTraceMagic)) != 0 ||
+      header.version != kTraceVersion || header.record_size != sizeof(TraceRecord)) {
+    return std::nullopt;
+  }
+  std::vector<TraceRecord> records;
+  TraceRecord record{};
+  while (std::fread(&record, sizeof(record), 1, in) == 1) {
+    records.push_back(record);
+  }
+  return records;
+}
+
+inline std::string_view TraceEventName(std::uint8_t kind) {
+  switch (static_cast<TraceEvent>(kind & ~kTraceEnd)) {
+    case TraceEvent::kPlace:
+      return "place";
+    case TraceEvent::kTake:
+      return "take";
+    case TraceEvent::kRoll:
+      return "roll";
+    case TraceEvent::kSmoke:
+      return "smoke";
+    case TraceEvent::kFinish:
+      return "finish";
+  }
+  return "unknown";
+}
+
+// перевод в формат Chrome Trace Event (JSON): B/E на каждое событие, время в микросекундах,
+// плюс метаданные thread_name, чтобы дорожки в просмотрщике подписывались ролью потока
+// записи разных потоков в файле перемешаны, просмотрщику порядок не важен
+// возвращает число событий или nullopt, если вход - не трасса
+inline std::optional<std::size_t> ConvertTraceToChromeJson(std::FILE* in, std::FILE* out) {
+  const auto records = ReadTrace(in);
+  if (!records) {
+    return std::nullopt;
+  }
+
+  std::fputs("{\"traceEvents\":[\n", out);
+  bool first = true;
+  auto separator = [&] {
+    std::fputs(first ? "" : ",\n", out);
+    first = false;
+  };
+
+  std::vector<bool> named;
+  for (const TraceRecord& record : *records) {
+    if (record.thread >= named.size()) {
+      named.resize(record.thread + 1u, false);
+    }
+    if (!named[record.thread]) { // поток подписываем по первому его событию
+      named[record.thread] = true;
+      const std::string_view role =
+          record.who < kSmokerCount ? SmokerLabelView(kAllSmokers[record.who]) : std::string_view("посредник");
+      separator();
+      std::fprintf(out,
+                   "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,"
+                   "\"args\":{\"name\":\"%.*s, поток %u\"}}",
+                   static_cast<unsigned>(record.thread), static_cast<int>(role.size()), role.data(),
+                   static_cast<unsigned>(record.thread));
+    }
+    const std::string_view name = TraceEventName(record.kind);
+    separator();
+    std::fprintf(out, "{\"name\":\"%.*s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":1,\"tid\":%u,\"args\":{\"n\":%u}}",
+                 static_cast<int>(name.size()), name.data(), (record.kind & kTraceEnd) != 0 ? 'E' : 'B',
+                 static_cast<double>(record.ns) / 1000.0, static_cast<unsigned>(record.thread),
+                 static_cast<unsigned>(record.arg));
+  }
+  std::fputs("\n]}\n", out);
+  return records->size();
+}
@@ -1,7 +1,9 @@
 #pragma once
 
 #include <array>
+#include <bit>
 #include <cstddef>
+#include <cstdint>
 #include <string>
 #include <string_view>
 
@@ -11,6 +13,7 @@
 // имена констант не попадают во внешнюю область видимости (нужно писать Ingredient::kTobacco)
 // нет неявного преобразования к целочисленным типам (в int придётся приводить через static_cast)
 // три константы этого типа и их целочисленные значения
+// для рецептов с N > 3 компонентами остальные значения получаются через IngredientAt(index)
 enum class Ingredient { kTobacco = 0, kPaper = 1, kMatches = 2 }; // префикс k в именах обозначает константу
 
 // функция возвращает целочисленный индекс для значения строгого перечисления Ingredient (enum class)
@@ -20,6 +23,79 @@ constexpr std::size_t IngredientIndex(Ingredient ingredient) {
   return static_cast<std::size_t>(ingredient);
 }
 
+// обратное преобразование: компонент по индексу, в том числе и за пределами трех именованных
+constexpr Ingredient IngredientAt(std::size_t index) {
+  return static_cast<Ingredient>(index);
+}
+
+// набор компонентов как битовая маска: бит IngredientIndex выставлен, если компонент есть в наборе
+using IngredientMask = std::uint32_t;
+
+// максимальное число компонентов, которое помещается в маску
+constexpr std::size_t kMaxIngredientCount = 32;
+
+constexpr IngredientMask IngredientBit(Ingredient ingredient) {
+  return IngredientMask{1} << IngredientIndex(ingredient);
+}
+
+// маска из всех N компонентов
+template <std::size_t N>
+constexpr IngredientMask kFullMask =
+    N == kMaxIngredientCount ? ~IngredientMask{0} : (IngredientMask{1} << N) - 1;
+
+// все N видов курильщиков, по одному на каждый компонент
+template <std::size_t N>
+constexpr std::array<Ingredient, N> MakeAllSmokers() {
+  std::array<Ingredient, N> smokers{};
+  for (std::size_t i = 0; i < N; ++i) {
+    smokers[i] = IngredientAt(i);
+  }
+  return smokers;
+}
+
+// для каждого курильщика - N - 1 компонентов, которых ему не хватает (все, кроме своего), по возрастанию индекса
+template <std::size_t N>
+constexpr std::array<std::array<Ingredient, N - 1>, N> MakeComponentsForSmoker() {
+  std::array<std::array<Ingredient, N - 1>, N> components{};
+  for (std::size_t smoker = 0; smoker < N; ++smoker) {
+    std::size_t next = 0;
+    for (std::size_t i = 0; i < N; ++i) {
+      if (i != smoker) {
+        components[smoker][next++] = IngredientAt(i);
+      }
+    }
+  }
+  return components;
+}
+
+// то же самое, но маской: курильщику i нужны все биты, кроме своего
+template <std::size_t N>
+constexpr std::array<IngredientMask, N> MakeNeedMasks() {
+  std::array<IngredientMask, N> masks{};
+  for (std::size_t i = 0; i < N; ++i) {
+    masks[i] = kFullMask<N> & ~IngredientBit(IngredientAt(i));
+  }
+  return masks;
+}
+
+// годится ли набор для стола на N компонентов: ровно N - 1 разных компонентов из первых N
+// пара из двух одинаковых (place(kPaper, kPaper)) - это один бит: такой набор не подходит никому
+// и, встав в голову очереди, запер бы стол; все столы такой набор не выкладывают и возвращают false
+template <std::size_t N>
+constexpr bool IsPlaceableSet(IngredientMask items) {
+  return std::popcount(items) == static_cast<int>(N - 1) && (items & ~kFullMask<N>) == 0;
+}
+
+template <std::size_t N>
+constexpr std::array<Ingredient, N> kAllSmokersOf = MakeAllSmokers<N>();
+
+template <std::size_t N>
+constexpr std::array<std::array<Ingredient, N - 1>, N> kComponentsForSmokerOf =
+    MakeComponentsForSmoker<N>();
+
+template <std::size_t N>
+constexpr std::array<IngredientMask, N> kNeedMaskOf = MakeNeedMasks<N>();
+
 // ф-ия нужна для того, чтобы быстро получить имя по индексу
 // названия ингридиентов в им. падеже
 constexpr std::array<std::string_view, 3> kIngredientNames{
@@ -30,36 +106,75 @@ constexpr std::array<std::string_view, 3> kSmokerResources{
     "табаком", "бумагой", "спичками"};
 
 // списко всех видов курильщиков
-constexpr std::array<Ingredient, 3> kAllSmokers{
-    Ingredient::kTobacco, Ingredient::kPaper, Ingredient::kMatches};
+constexpr std::array<Ingredient, 3> kAllSmokers = kAllSmokersOf<3>;
 
 // кол-во типов курильщиков
 constexpr std::size_t kSmokerCount = kAllSmokers.size();
 
 // пара компонентов, который кладет на стол посредник
 // другими словами, два компонента, которых не хватает для конкретного курильщика
-constexpr std::array<std::array<Ingredient, 2>, 3> kComponentsForSmoker{{
-    {Ingredient::kPaper, Ingredient::kMatches},
-    {Ingredient::kTobacco, Ingredient::kMatches},
-    {Ingredient::kTobacco, Ingredient::kPaper},
-}};
+// {бумага, спички}, {табак, спички}, {табак, бумага}
+constexpr std::array<std::array<Ingredient, 2>, 3> kComponentsForSmoker =
+    kComponentsForSmokerOf<3>;
+
+// подписи курильщиков "курильщик с ..." собираются на этапе компиляции,
+// чтобы в цикле раунда не склеивать строки и не выделять память
+constexpr std::string_view kSmokerLabelPrefix = "курильщик с ";
+
+template <std::size_t Index>
+constexpr auto MakeSmokerLabel() {
+  constexpr std::size_t kSize = kSmokerLabelPrefix.size() + kSmokerResources[Index].size();
+  std::array<char, kSize> label{};
+  std::size_t next = 0;
+  for (const char ch : kSmokerLabelPrefix) {
+    label[next++] = ch;
+  }
+  for (const char ch : kSmokerResources[Index]) {
+    label[next++] = ch;
+  }
+  return label;
+}
+
+template <std::size_t Index>
+constexpr auto kSmokerLabelChars = MakeSmokerLabel<Index>();
+
+template <std::size_t Index>
+constexpr std::string_view kSmokerLabelView{kSmokerLabelChars<Index>.data(),
+                                            kSmokerLabelChars<Index>.size()};
+
+constexpr std::array<std::string_view, 3> kSmokerLabels{
+    kSmokerLabelView<0>, kSmokerLabelView<1>, kSmokerLabelView<2>};
 
 // ф-ия возвращает строковое имя ингридинета по индексу (по значению перечисление Ingredient)
-std::string_view IngredientToString(Ingredient ingredient) {
+constexpr std::string_view IngredientToString(Ingredient ingredient) {
   return kIngredientNames[IngredientIndex(ingredient)];
 }
 
 // ф-ия возвращает тип курильщака в формате:
 // курильщик с ...
-std::string SmokerLabel(Ingredient ingredient) {
-  const auto index = IngredientIndex(ingredient);
-  return std::string{"курильщик с "} + std::string{kSmokerResources[index]};
+inline std::string SmokerLabel(Ingredient ingredient) {
+  return std::string{kSmokerLabels[IngredientIndex(ingredient)]};
+}
+
+// то же самое без выделения памяти
+constexpr std::string_view SmokerLabelView(Ingredient ingredient) {
+  return kSmokerLabels[IngredientIndex(ingredient)];
+}
+
+// ф-ия возвращает недостающие компненты для курильщика при N компонентах
+template <std::size_t N>
+constexpr std::array<Ingredient, N - 1> ComponentsFor(Ingredient smoker) {
+  return kComponentsForSmokerOf<N>[IngredientIndex(smoker)];
 }
 
 // ф-ия возвращает недостающие компненты для конкретного курильщика
 // курильщику недостает *пары компонентов*
-std::array<Ingredient, 2> ComponentsFor(Ingredient smoker) {
+inline std::array<Ingredient, 2> ComponentsFor(Ingredient smoker) {
   return kComponentsForSmoker[IngredientIndex(smoker)];
 }
 
-
+// маска компонентов, которые нужны курильщику
+template <std::size_t N>
+constexpr IngredientMask NeedMaskFor(Ingredient smoker) {
+  return kNeedMaskOf<N>[IngredientIndex(smoker)];
+}
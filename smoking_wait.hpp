@@ -0,0 +1,109 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+
+
+// политики ожидания для BasicSmokingTable: как потоку переждать, пока предикат ложен
+// стол зовет WaitPolicy::pause(cv, lock, attempt) в цикле, пока предикат не станет истинным:
+// на входе и на выходе lock захвачен, attempt - номер попытки с нуля
+// политика - параметр шаблона, поэтому в горячем пути нет виртуальных вызовов
+// будит стол через NotifyOne<WaitPolicy>/NotifyAll<WaitPolicy>: обычно это просто cv.notify_*,
+// но политика может объявить свои notifyOne(cv)/notifyAll(cv) - так ExploreWait (smoking_explore.hpp)
+// видит каждое пробуждение; политике, которая не спит на cv, это просто не нужно
+// pauseUntil(cv, lock, attempt, deadline) - то же, но не дольше deadline (для startSmokingFor() и т.п.);
+// вернуться раньше срока можно всегда, стол сам проверит и предикат, и срок
+
+// подсказка процессору, что мы в цикле ожидания: на x86 pause, на ARM yield
+// ядро не жжет конвейер спекулятивными чтениями и отдает ресурсы соседнему гиперпотоку
+inline void CpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+  asm volatile("yield" ::: "memory");
+#endif
+}
+
+// как было: сразу засыпаем в ядре на условной переменной
+// дешево по процессору, но пробуждение стоит микросекунды - это заметно только на коротких раундах
+struct BlockingWait {
+  static void pause(std::condition_variable& cv, std::unique_lock<std::mutex>& lock, std::size_t) {
+    cv.wait(lock);
+  }
+
+  static void pauseUntil(std::condition_variable& cv, std::unique_lock<std::mutex>& lock, std::size_t,
+                         std::chrono::steady_clock::time_point deadline) {
+    cv.wait_until(lock, deadline);
+  }
+};
+
+// сначала крутимся SpinRounds попыток без мьютекса, удваивая число pause от попытки к попытке,
+// и только потом паркуемся на условной переменной
+// пока крутимся, поток считается ждущим (idle_count), так что пару ему все равно отдадут
+template <std::size_t SpinRounds = 10>
+struct SpinThenParkWait {
+  static void pause(std::condition_variable& cv, std::unique_lock<std::mutex>& lock,
+                    std::size_t attempt) {
+    if (attempt >= SpinRounds) {
+      cv.wait(lock);
+      return;
+    }
+    Spin(lock, attempt);
+  }
+
+  static void pauseUntil(std::condition_variable& cv, std::unique_lock<std::mutex>& lock,
+                         std::size_t attempt, std::chrono::steady_clock::time_point deadline) {
+    if (attempt >= SpinRounds) {
+      cv.wait_until(lock, deadline);
+      return;
+    }
+    Spin(lock, attempt); // спин короче любого разумного срока, его не прерываем
+  }
+
+ private:
+  static void Spin(std::unique_lock<std::mutex>& lock, std::size_t attempt) {
+    lock.unlock();
+    const std::size_t spins = std::size_t{1} << (attempt < 6 ? attempt : 6); // до 64 pause за попытку
+    for (std::size_t i = 0; i < spins; ++i) {
+      CpuRelax();
+    }
+    lock.lock();
+  }
+};
+
+// не засыпаем вообще: отпускаем мьютекс и отдаем квант планировщику
+// задержка минимальная, но ждущий поток занимает ядро все время ожидания - только для коротких раундов
+struct YieldWait {
+  static void pause(std::condition_variable&, std::unique_lock<std::mutex>& lock, std::size_t) {
+    lock.unlock();
+    std::this_thread::yield();
+    lock.lock();
+  }
+
+  static void pauseUntil(std::condition_variable& cv, std::unique_lock<std::mutex>& lock,
+                         std::size_t attempt, std::chrono::steady_clock::time_point) {
+    pause(cv, lock, attempt);
+  }
+};
+
+// разбудить ждущих на cv так, как того хочет политика; без своих notifyOne/notifyAll - обычный notify_*
+template <typename WaitPolicy>
+void NotifyOne(std::condition_variable& cv) {
+  if constexpr (requires { WaitPolicy::notifyOne(cv); }) {
+    WaitPolicy::notifyOne(cv);
+  } else {
+    cv.notify_one();
+  }
+}
+
+template <typename WaitPolicy>
+void NotifyAll(std::condition_variable& cv) {
+  if constexpr (requires { WaitPolicy::notifyAll(cv); }) {
+    WaitPolicy::notifyAll(cv);
+  } else {
+    cv.notify_all();
+  }
+}
@@ -3,15 +3,67 @@
 #include <chrono>
 #include <atomic>
 #include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <memory>
+#include <stop_token>
+#include <array>
 
 #include "smoking_types.hpp"
 #include "smoking_table.hpp"
+#include "smoking_atomic_table.hpp"
 #include "smoking_io.hpp"
+#include "smoking_simulation.hpp"
+#include "smoking_coro.hpp"
+#include "smoking_cluster.hpp"
+#include "smoking_padding.hpp"
+#include "smoking_shm_table.hpp"
+#include "smoking_agent.hpp"
+#include "smoking_trace.hpp"
+#include "smoking_replay.hpp"
+#include "smoking_inventory.hpp"
+#include "smoking_pool.hpp"
+#include "smoking_explore.hpp"
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+//    ; make test   :
+//  SmokingTable   -DSMOKING_TEST_TABLE=AtomicSmokingTable
+#ifndef SMOKING_TEST_TABLE
+#define SMOKING_TEST_TABLE SmokingTable
+#endif
+using TableUnderTest = SMOKING_TEST_TABLE;
+
+//   :  operator new   ,   
+static std::atomic<long> g_allocations{0};
+
+void* operator new(std::size_t size) {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* memory = std::malloc(size == 0 ? 1 : size)) {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+// gcc  free()  new  ,      malloc()  operator new 
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+void operator delete(void* memory) noexcept {
+    std::free(memory);
+}
+
+void operator delete(void* memory, std::size_t) noexcept {
+    std::free(memory);
+}
+#pragma GCC diagnostic pop
 
 class SmokingTableTest : public ::testing::Test {
 protected:
     void SetUp() override {
-        table = std::make_unique<SmokingTable>();
+        table = std::make_unique<TableUnderTest>();
     }
 
     void TearDown() override {
@@ -21,7 +73,7 @@ protected:
         std::this_thread::sleep_for(std::chrono::milliseconds(10));
     }
 
-    std::unique_ptr<SmokingTable> table;
+    std::unique_ptr<TableUnderTest> table;
     std::mutex test_mutex;
 };
 
@@ -341,11 +393,1497 @@ TEST_F(SmokingTableTest, MixedComponentCombinations) {
     EXPECT_EQ(correct_matches[2].load(), 1);
 }
 
+//  10:  -    ,   
+TEST(PipelinedSmokingTableTest, PlaceDoesNotWaitWhilePipelineHasRoom) {
+    SmokingTable pipelined(3);
+
+    //  ,        place()  
+    pipelined.place(Ingredient::kPaper, Ingredient::kMatches);
+    pipelined.place(Ingredient::kTobacco, Ingredient::kMatches);
+    pipelined.place(Ingredient::kTobacco, Ingredient::kPaper);
+
+    //       ;    startSmoking(kTobacco),
+    //    ,   startSmoking()   ,    
+    std::atomic<bool> tobacco_may_take{false};
+    std::atomic<int> early_takes{0};
+    std::atomic<int> started{0};
+    std::array<std::atomic<int>, 3> counts{};
+    auto smoker_task = [&](Ingredient ingredient) {
+        started++;
+        while (pipelined.startSmoking(ingredient)) {
+            if (!tobacco_may_take.load()) {
+                early_takes++;
+            }
+            counts[IngredientIndex(ingredient)]++;
+            pipelined.finishSmoking();
+        }
+    };
+
+    //       ,     ,      
+    std::thread smoker2(smoker_task, Ingredient::kPaper);
+    std::thread smoker3(smoker_task, Ingredient::kMatches);
+    while (started.load() < 2) { //     
+        std::this_thread::yield();
+    }
+
+    tobacco_may_take = true;
+    EXPECT_TRUE(pipelined.startSmoking(Ingredient::kTobacco));
+    counts[IngredientIndex(Ingredient::kTobacco)]++;
+    pipelined.finishSmoking();
+
+    pipelined.waitForRoundEnd();
+    pipelined.finish();
+    smoker2.join();
+    smoker3.join();
+
+    EXPECT_EQ(early_takes.load(), 0);
+    for (const auto& count : counts) {
+        EXPECT_EQ(count.load(), 1);
+    }
+}
+
+//  11:   2    ,    
+TEST(PipelinedSmokingTableTest, AgentPlacesWhileSmokerIsBusy) {
+    SmokingTable pipelined(2);
+    std::atomic<bool> release_smoker{false};
+    std::atomic<bool> smoker_finished{false};
+
+    std::thread smoker([&]() {
+        if (pipelined.startSmoking(Ingredient::kTobacco)) {
+            while (!release_smoker) {
+                std::this_thread::yield();
+            }
+            pipelined.finishSmoking();
+            smoker_finished = true;
+        }
+    });
+
+    pipelined.place(Ingredient::kPaper, Ingredient::kMatches);
+    pipelined.place(Ingredient::kTobacco, Ingredient::kMatches); //     
+    EXPECT_FALSE(smoker_finished.load());
+
+    release_smoker = true;
+    smoker.join();
+    pipelined.finish();
+}
+
+//  12:    N     
+static_assert(kComponentsForSmoker[0] == std::array<Ingredient, 2>{Ingredient::kPaper, Ingredient::kMatches});
+static_assert(kComponentsForSmoker[1] == std::array<Ingredient, 2>{Ingredient::kTobacco, Ingredient::kMatches});
+static_assert(kComponentsForSmoker[2] == std::array<Ingredient, 2>{Ingredient::kTobacco, Ingredient::kPaper});
+static_assert(NeedMaskFor<5>(IngredientAt(3)) == 0b10111);
+static_assert(ComponentsFor<5>(IngredientAt(0))[3] == IngredientAt(4));
+
+TEST(GenericSmokingTableTest, FiveIngredientsEachSmokerGetsItsSet) {
+    constexpr std::size_t kIngredients = 5;
+    BasicSmokingTable<kIngredients> generic;
+    std::array<std::atomic<int>, kIngredients> counts{};
+
+    auto smoker_task = [&](Ingredient ingredient) {
+        while (generic.startSmoking(ingredient)) {
+            counts[IngredientIndex(ingredient)]++;
+            generic.finishSmoking();
+        }
+    };
+
+    std::vector<std::thread> smokers;
+    for (const Ingredient smoker : kAllSmokersOf<kIngredients>) {
+        smokers.emplace_back(smoker_task, smoker);
+    }
+
+    for (const Ingredient smoker : kAllSmokersOf<kIngredients>) {
+        generic.place(NeedMaskFor<kIngredients>(smoker));
+        generic.waitForRoundEnd();
+    }
+
+    generic.finish();
+    for (auto& smoker : smokers) {
+        smoker.join();
+    }
+
+    for (const auto& count : counts) {
+        EXPECT_EQ(count.load(), 1);
+    }
+}
+
+//  13:  -        
+TEST(SmokerPoolTest, TwoWorkersOfOneTypeSmokeConcurrently) {
+    SmokingTable pooled(2);
+    std::atomic<int> active{0};
+    std::atomic<int> max_active{0};
+
+    auto worker_task = [&]() {
+        if (pooled.startSmoking(Ingredient::kTobacco)) {
+            const int now_active = ++active;
+            int expected = max_active.load();
+            while (now_active > expected && !max_active.compare_exchange_weak(expected, now_active)) {
+            }
+            //  ,   
+            const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+            while (max_active.load() < 2 && std::chrono::steady_clock::now() < deadline) {
+                std::this_thread::yield();
+            }
+            pooled.finishSmoking();
+        }
+    };
+
+    std::thread worker1(worker_task);
+    std::thread worker2(worker_task);
+    while (pooled.idleSmokers(Ingredient::kTobacco) < 2) {
+        std::this_thread::yield();
+    }
+
+    pooled.place(Ingredient::kPaper, Ingredient::kMatches);
+    pooled.place(Ingredient::kPaper, Ingredient::kMatches);
+    pooled.waitForRoundEnd();
+
+    worker1.join();
+    worker2.join();
+    pooled.finish();
+
+    EXPECT_EQ(max_active.load(), 2);
+    EXPECT_EQ(pooled.idleSmokers(Ingredient::kTobacco), 0u);
+}
+
+//       
+static std::vector<std::string> ReadLines(std::FILE* file) {
+    std::rewind(file);
+    std::vector<std::string> lines;
+    std::string line;
+    int ch = 0;
+    while ((ch = std::fgetc(file)) != EOF) {
+        if (ch == '\n') {
+            lines.push_back(line);
+            line.clear();
+        } else {
+            line.push_back(static_cast<char>(ch));
+        }
+    }
+    return lines;
+}
+
+//  14:           
+TEST(AsyncLoggerTest, KeepsPerThreadOrderAndFlushesOnShutdown) {
+    constexpr int kThreads = 4;
+    constexpr int kMessages = 2000;
+    std::FILE* file = std::tmpfile();
+    ASSERT_NE(file, nullptr);
+    {
+        AsyncLogger logger(file, AsyncLogger::OverflowPolicy::kBlock, 1024); //   -    
+        std::vector<std::thread> threads;
+        for (int t = 0; t < kThreads; ++t) {
+            threads.emplace_back([&logger, t]() {
+                for (int i = 0; i < kMessages; ++i) {
+                    logger.log(std::to_string(t) + " " + std::to_string(i));
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+
+    const auto lines = ReadLines(file);
+    std::fclose(file);
+    ASSERT_EQ(lines.size(), static_cast<std::size_t>(kThreads * kMessages));
+    std::array<int, kThreads> next{};
+    for (const auto& line : lines) {
+        const int thread = std::stoi(line.substr(0, line.find(' ')));
+        const int index = std::stoi(line.substr(line.find(' ') + 1));
+        EXPECT_EQ(index, next[thread]);
+        next[thread] = index + 1;
+    }
+}
+
+//  15:  kDrop       
+TEST(AsyncLoggerTest, DropPolicyCountsDroppedMessages) {
+    constexpr int kMessages = 5000;
+    std::FILE* file = std::tmpfile();
+    ASSERT_NE(file, nullptr);
+    std::uint64_t dropped = 0;
+    {
+        AsyncLogger logger(file, AsyncLogger::OverflowPolicy::kDrop, 256);
+        for (int i = 0; i < kMessages; ++i) {
+            logger.log(",      ");
+        }
+        logger.flush();
+        dropped = logger.dropped();
+    }
+
+    const auto lines = ReadLines(file);
+    std::fclose(file);
+    EXPECT_EQ(lines.size() + dropped, static_cast<std::size_t>(kMessages));
+}
+
+//  16:     
+TEST(MessageFormattingTest, FormatsTheSameTextAsBefore) {
+    //    cp1251,     -  UTF-8,    ,    
+    LabelBuffer label;
+    FormatWorkerLabel(label, Ingredient::kPaper, 2);
+    EXPECT_EQ(std::string{label.view()}, SmokerLabel(Ingredient::kPaper) + " #2");
+
+    LineBuffer message;
+    FormatAgentPlace(message, Ingredient::kTobacco, 7);
+    const std::string placed{message.view()};
+    EXPECT_NE(placed.find(std::string{IngredientToString(Ingredient::kPaper)}), std::string::npos);
+    EXPECT_NE(placed.find(std::string{IngredientToString(Ingredient::kMatches)}), std::string::npos);
+    EXPECT_NE(placed.find(SmokerLabel(Ingredient::kTobacco)), std::string::npos);
+    EXPECT_EQ(placed.substr(placed.size() - 3), "#7.");
+
+    message.clear();
+    FormatSmokerRolled(message, label.view(), 12);
+    const std::string rolled{message.view()};
+    EXPECT_EQ(rolled.find(std::string{label.view()}), 0u);
+    EXPECT_EQ(rolled.substr(rolled.size() - 4), "#12.");
+}
+
+//  17:   (, , )   
+TEST(MessageFormattingTest, FullRoundDoesNotAllocate) {
+    constexpr int kWarmupRounds = 3;
+    constexpr int kMeasuredRounds = 200;
+    std::FILE* file = std::tmpfile();
+    ASSERT_NE(file, nullptr);
+    AsyncLogger logger(file);
+    SmokingTable round_table;
+    LabelBuffer label;
+    FormatWorkerLabel(label, Ingredient::kTobacco, 1);
+
+    std::thread smoker([&]() {
+        int counter = 0;
+        while (round_table.startSmoking(Ingredient::kTobacco)) {
+            ++counter;
+            LineBuffer message;
+            FormatSmokerTake(message, label.view(), Ingredient::kTobacco);
+            logger.log(message.view());
+            message.clear();
+            FormatSmokerRolled(message, label.view(), counter);
+            logger.log(message.view());
+            message.clear();
+            FormatSmokerFinished(message, label.view(), counter);
+            logger.log(message.view());
+            round_table.finishSmoking();
+        }
+    });
+
+    auto run_rounds = [&](int first, int count) {
+        for (int round = first; round < first + count; ++round) {
+            LineBuffer message;
+            FormatAgentPlace(message, Ingredient::kTobacco, round);
+            logger.log(message.view());
+            round_table.place(Ingredient::kPaper, Ingredient::kMatches);
+            round_table.waitForRoundEnd();
+        }
+    };
+
+    run_rounds(1, kWarmupRounds); //       
+    logger.flush();
+    const long before = g_allocations.load();
+    run_rounds(1 + kWarmupRounds, kMeasuredRounds);
+    logger.flush();
+    const long after = g_allocations.load();
+
+    round_table.finish();
+    smoker.join();
+    std::fclose(file);
+
+    EXPECT_EQ(after - before, 0);
+}
+
+#ifdef SMOKING_TABLE_METRICS
+//  18:    ,   
+TEST(TableMetricsTest, CountsRoundsAndWaits) {
+    SmokingTable measured;
+    constexpr int kRounds = 30;
+
+    auto smoker_task = [&](Ingredient ingredient) {
+        while (measured.startSmoking(ingredient)) {
+            measured.finishSmoking();
+        }
+    };
+    std::thread smoker1(smoker_task, Ingredient::kTobacco);
+    std::thread smoker2(smoker_task, Ingredient::kPaper);
+    std::thread smoker3(smoker_task, Ingredient::kMatches);
+
+    for (int i = 0; i < kRounds; ++i) {
+        const auto components = ComponentsFor(kAllSmokers[static_cast<std::size_t>(i) % kSmokerCount]);
+        measured.place(components[0], components[1]);
+        measured.waitForRoundEnd();
+    }
+    const auto metrics = measured.snapshot(); //   ,   
+
+    measured.finish();
+    smoker1.join();
+    smoker2.join();
+    smoker3.join();
+
+    EXPECT_EQ(metrics.rounds_completed, static_cast<std::uint64_t>(kRounds));
+    for (const auto taken : metrics.rounds_taken) {
+        EXPECT_EQ(taken, static_cast<std::uint64_t>(kRounds / 3));
+    }
+    EXPECT_EQ(metrics.place_wait.count, static_cast<std::uint64_t>(kRounds));
+    EXPECT_EQ(metrics.round_end_wait.count, static_cast<std::uint64_t>(kRounds));
+    EXPECT_EQ(metrics.start_wait.count, static_cast<std::uint64_t>(kRounds));
+    EXPECT_LE(metrics.spurious_wakeups, metrics.smoker_wakeups);
+    EXPECT_LE(metrics.wake_latency.count, static_cast<std::uint64_t>(kRounds));
+}
+#endif
+
+//  19:  -        
+TEST(SimulationTest, SerialRoundsTakeRollPlusSmokeEach) {
+    SimulationConfig config;
+    config.rounds = 1000;
+    const SimulationResult result = RunSimulation(config);
+
+    EXPECT_EQ(result.rounds, 1000u);
+    EXPECT_EQ(result.elapsed, std::chrono::milliseconds(450) * 1000);
+    std::uint64_t total = 0;
+    for (const auto count : result.smoked_count) {
+        total += count;
+    }
+    EXPECT_EQ(total, 1000u);
+    EXPECT_EQ(result.latencyPercentile(0.99), VirtualDuration{0}); //   
+}
+
+//  20:  -      ,    
+TEST(SimulationTest, MillionRoundsAreFastAndDeterministic) {
+    SimulationConfig config;
+    config.rounds = 1000000;
+    config.depth = 6;
+    config.smokers_per_type = 2;
+    config.smoking.fill(DurationDistribution::Exponential(std::chrono::milliseconds(300)));
+    config.seed = 42;
+
+    const SimulationResult first = RunSimulation(config);
+    const SimulationResult second = RunSimulation(config);
+
+    EXPECT_EQ(first.rounds, 1000000u);
+    EXPECT_EQ(first.elapsed, second.elapsed);
+    EXPECT_EQ(first.smoked_count, second.smoked_count);
+    EXPECT_GT(first.fairness(), 0.99);
+    //     - ,    
+    EXPECT_GT(first.roundsPerSecond(), 1.0 / 0.45);
+}
+
+//  21:   
+TEST(SimulationTest, ParsesDurationDistributions) {
+    const auto constant = ParseDurationDistribution("300");
+    ASSERT_TRUE(constant.has_value());
+    EXPECT_EQ(constant->kind, DurationDistribution::Kind::kConstant);
+    EXPECT_EQ(constant->first, std::chrono::milliseconds(300));
+
+    const auto uniform = ParseDurationDistribution("uniform:100:500");
+    ASSERT_TRUE(uniform.has_value());
+    EXPECT_EQ(uniform->kind, DurationDistribution::Kind::kUniform);
+    EXPECT_EQ(uniform->second, std::chrono::milliseconds(500));
+
+    EXPECT_TRUE(ParseDurationDistribution("exp:0.5").has_value());
+
+    //   -   sleep_for; exp:0   ,     
+    std::mt19937_64 rng(1);
+    for (const std::string_view text : {"0", "uniform:0:0", "exp:0"}) {
+        const auto zero = ParseDurationDistribution(text);
+        ASSERT_TRUE(zero.has_value());
+        EXPECT_EQ(zero->sample(rng), VirtualDuration{0});
+    }
+    EXPECT_FALSE(ParseDurationDistribution("uniform:500:100").has_value());
+    EXPECT_FALSE(ParseDurationDistribution("gauss:1").has_value());
+}
+
+CoroExecutor::Task CountingSmoker(AsyncSmokingTable& table, Ingredient ingredient, std::atomic<int>& smoked) {
+    while (true) { // co_await    while g++ 12  
+        const bool took = co_await table.startSmoking(ingredient);
+        if (!took) {
+            break;
+        }
+        smoked.fetch_add(1);
+        table.finishSmoking();
+    }
+}
+
+CoroExecutor::Task PipelinedAgent(AsyncSmokingTable& table, int rounds) {
+    for (int round = 0; round < rounds; ++round) {
+        const auto components = ComponentsFor(kAllSmokers[static_cast<std::size_t>(round) % kSmokerCount]);
+        co_await table.place(components[0], components[1]);
+    }
+    co_await table.waitForRoundEnd();
+    table.finish();
+}
+
+//  22:         
+TEST(CoroutineTableTest, ThousandTablesOnTwoThreads) {
+    constexpr std::size_t kTables = 1000;
+    constexpr int kRounds = 30;
+    CoroExecutor executor(2);
+    std::vector<std::unique_ptr<AsyncSmokingTable>> tables;
+    std::vector<std::array<std::atomic<int>, kSmokerCount>> smoked(kTables);
+    for (std::size_t i = 0; i < kTables; ++i) {
+        tables.push_back(std::make_unique<AsyncSmokingTable>(executor, 1 + i % 3));
+    }
+    for (std::size_t i = 0; i < kTables; ++i) {
+        for (const Ingredient ingredient : kAllSmokers) {
+            executor.spawn(CountingSmoker(*tables[i], ingredient, smoked[i][IngredientIndex(ingredient)]));
+        }
+        executor.spawn(PipelinedAgent(*tables[i], kRounds));
+    }
+    executor.waitIdle(); //     ,  
+
+    for (std::size_t i = 0; i < kTables; ++i) {
+        for (const auto& count : smoked[i]) {
+            EXPECT_EQ(count.load(), kRounds / static_cast<int>(kSmokerCount));
+        }
+    }
+}
+
+//  23: finish()  ,    ,  startSmoking()  false
+TEST(CoroutineTableTest, FinishResumesWaitingSmokers) {
+    CoroExecutor executor(1);
+    AsyncSmokingTable table(executor);
+    std::array<std::atomic<int>, kSmokerCount> smoked{};
+    for (const Ingredient ingredient : kAllSmokers) {
+        executor.spawn(CountingSmoker(table, ingredient, smoked[IngredientIndex(ingredient)]));
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    table.finish();
+    executor.waitIdle();
+    for (const auto& count : smoked) {
+        EXPECT_EQ(count.load(), 0);
+    }
+}
+
+//  24:     -     ,  
+TEST(TableClusterTest, RunsAllTablesAndMergesCounts) {
+    ClusterConfig config;
+    config.tables = 4;
+    config.smokers_per_type = 2;
+    config.depth = 3;
+    config.rounds_per_table = 500;
+    TableCluster cluster(config);
+    const ClusterStats stats = cluster.run();
+
+    EXPECT_EQ(stats.rounds, 4u * 500u);
+    ASSERT_EQ(stats.smoked_count.size(), 4u);
+    std::uint64_t by_type_total = 0;
+    for (const auto count : stats.smoked_by_type) {
+        EXPECT_GT(count, 0u);
+        by_type_total += count;
+    }
+    EXPECT_EQ(by_type_total, stats.rounds);
+    for (const auto& table_counts : stats.smoked_count) {
+        ASSERT_EQ(table_counts.size(), 2 * kSmokerCount);
+        std::uint64_t table_total = 0;
+        for (const auto count : table_counts) {
+            table_total += count;
+        }
+        EXPECT_EQ(table_total, 500u);
+    }
+    EXPECT_GT(stats.roundsPerSecond(), 0.0);
+}
+
+//  25:          
+TEST(CacheLayoutTest, CountersAndTableSlotsDoNotShareLines) {
+    static_assert(alignof(CachePadded<int>) == kCacheLineSize);
+    static_assert(sizeof(PaddedCounters<3>) == 3 * kCacheLineSize);
+    static_assert(alignof(SmokingTable) == kCacheLineSize);
+    static_assert(alignof(AtomicSmokingTable) == kCacheLineSize);
+
+    PaddedCounters<kSmokerCount> counters{};
+    for (std::size_t i = 0; i + 1 < counters.size(); ++i) {
+        const auto here = reinterpret_cast<std::uintptr_t>(&counters[i]);
+        const auto next = reinterpret_cast<std::uintptr_t>(&counters[i + 1]);
+        EXPECT_NE(here / kCacheLineSize, next / kCacheLineSize);
+    }
+
+    std::vector<std::thread> threads;
+    for (std::size_t i = 0; i < counters.size(); ++i) {
+        threads.emplace_back([&counters, i] {
+            for (int n = 0; n < 1000; ++n) {
+                ++counters[i];
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    EXPECT_EQ(counters.total(), 3000); //    
+}
+
+template <typename Table>
+void RunPolicyRounds(int rounds) {
+    Table table(3);
+    std::array<std::atomic<int>, kSmokerCount> smoked{};
+    std::vector<std::thread> smokers;
+    for (std::size_t i = 0; i < 2 * kSmokerCount; ++i) {
+        smokers.emplace_back([&table, &smoked, i] {
+            const Ingredient ingredient = kAllSmokers[i % kSmokerCount];
+            while (table.startSmoking(ingredient)) {
+                smoked[IngredientIndex(ingredient)].fetch_add(1);
+                table.finishSmoking();
+            }
+        });
+    }
+    for (int round = 0; round < rounds; ++round) {
+        const auto components = ComponentsFor(kAllSmokers[static_cast<std::size_t>(round) % kSmokerCount]);
+        table.place(components[0], components[1]);
+    }
+    table.waitForRoundEnd();
+    table.finish();
+    for (auto& smoker : smokers) {
+        smoker.join();
+    }
+    for (const auto& count : smoked) {
+        EXPECT_EQ(count.load(), rounds / static_cast<int>(kSmokerCount));
+    }
+}
+
+//  26:      yield     ,  
+TEST(WaitPolicyTest, SpinAndYieldTablesRunAllRounds) {
+    RunPolicyRounds<SpinningSmokingTable>(3000);
+    RunPolicyRounds<YieldingSmokingTable>(3000);
+    RunPolicyRounds<BasicSmokingTable<kSmokerCount, SpinThenParkWait<0>>>(300); //  
+}
+
+//  27: runRound()   ,    
+TEST_F(SmokingTableTest, RunRoundWaitsForItsRound) {
+    std::array<std::atomic<int>, kSmokerCount> smoked{};
+    std::vector<std::thread> smokers;
+    for (const Ingredient ingredient : kAllSmokers) {
+        smokers.emplace_back([this, &smoked, ingredient] {
+            while (table->startSmoking(ingredient)) {
+                smoked[IngredientIndex(ingredient)].fetch_add(1);
+                table->finishSmoking();
+            }
+        });
+    }
+    for (int round = 0; round < 30; ++round) {
+        const Ingredient smoker = kAllSmokers[static_cast<std::size_t>(round) % kSmokerCount];
+        const auto components = ComponentsFor(smoker);
+        ASSERT_TRUE(table->runRound(components[0], components[1]));
+        EXPECT_EQ(smoked[IngredientIndex(smoker)].load(), round / static_cast<int>(kSmokerCount) + 1);
+    }
+    table->finish();
+    for (auto& smoker : smokers) {
+        smoker.join();
+    }
+    const auto components = ComponentsFor(Ingredient::kTobacco);
+    EXPECT_FALSE(table->runRound(components[0], components[1])); //  
+}
+
+//  28: runRounds()         
+TEST(RoundSequenceTest, RunRoundsCompletesWholeBatch) {
+    SmokingTable table(3);
+    std::atomic<int> smoked{0};
+    std::vector<std::thread> smokers;
+    for (std::size_t i = 0; i < 2 * kSmokerCount; ++i) {
+        smokers.emplace_back([&table, &smoked, i] {
+            while (table.startSmoking(kAllSmokers[i % kSmokerCount])) {
+                smoked.fetch_add(1);
+                table.finishSmoking();
+            }
+        });
+    }
+    std::vector<std::array<Ingredient, 2>> batch;
+    for (std::size_t round = 0; round < 300; ++round) {
+        batch.push_back(ComponentsFor(kAllSmokers[round % kSmokerCount]));
+    }
+    EXPECT_EQ(table.runRounds(batch), 300u);
+    EXPECT_EQ(smoked.load(), 300); //  -   
+    EXPECT_EQ(table.runRounds(std::span<const std::array<Ingredient, 2>>(batch).first(30)), 30u);
+    EXPECT_EQ(smoked.load(), 330);
+    table.finish();
+    for (auto& smoker : smokers) {
+        smoker.join();
+    }
+}
+
+//  29: try-    
+TEST(BoundedWaitTest, TryVariantsNeverBlock) {
+    SmokingTable table;
+    EXPECT_FALSE(table.tryStartSmoking(Ingredient::kTobacco)); //  
+    EXPECT_EQ(table.idleSmokers(Ingredient::kTobacco), 0u);
+    EXPECT_TRUE(table.tryPlace(Ingredient::kPaper, Ingredient::kMatches));
+    EXPECT_FALSE(table.tryPlace(Ingredient::kTobacco, Ingredient::kMatches)); //   1  
+    EXPECT_FALSE(table.tryStartSmoking(Ingredient::kPaper)); //   
+    EXPECT_TRUE(table.tryStartSmoking(Ingredient::kTobacco));
+    EXPECT_FALSE(table.waitForRoundEndFor(std::chrono::milliseconds(0)));
+    table.finishSmoking();
+    EXPECT_TRUE(table.waitForRoundEndFor(std::chrono::milliseconds(0)));
+}
+
+//  30: _for/_until   ,    
+TEST(BoundedWaitTest, TimedVariantsReturnAtDeadline) {
+    SmokingTable table;
+    const auto timeout = std::chrono::milliseconds(30);
+
+    auto start = std::chrono::steady_clock::now();
+    EXPECT_FALSE(table.startSmokingFor(Ingredient::kTobacco, timeout));
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    EXPECT_GE(elapsed, timeout);
+    EXPECT_LT(elapsed, std::chrono::seconds(2));
+    EXPECT_EQ(table.idleSmokers(Ingredient::kTobacco), 0u); //  -    
+
+    ASSERT_TRUE(table.tryPlace(Ingredient::kPaper, Ingredient::kMatches));
+    start = std::chrono::steady_clock::now();
+    EXPECT_FALSE(table.placeUntil(Ingredient::kTobacco, Ingredient::kPaper, start + timeout));
+    EXPECT_GE(std::chrono::steady_clock::now() - start, timeout);
+    EXPECT_FALSE(table.waitForRoundEndUntil(std::chrono::system_clock::now() + timeout)); //    
+
+    EXPECT_TRUE(table.startSmokingFor(Ingredient::kTobacco, timeout)); //    -  
+    table.finishSmoking();
+}
+
+//  31: stop_token   ,      
+TEST(BoundedWaitTest, StopTokenCancelsOneSmokerPromptly) {
+    SmokingTable table;
+    std::stop_source cancelled_source;
+    std::atomic<bool> cancelled_result{true};
+    std::atomic<bool> colleague_result{false};
+
+    std::thread cancelled([&] {
+        cancelled_result = table.startSmoking(Ingredient::kTobacco, cancelled_source.get_token());
+    });
+    std::stop_source colleague_source;
+    std::thread colleague([&] {
+        colleague_result = table.startSmoking(Ingredient::kTobacco, colleague_source.get_token());
+        if (colleague_result) {
+            table.finishSmoking();
+        }
+    });
+    while (table.idleSmokers(Ingredient::kTobacco) < 2) {
+        std::this_thread::yield();
+    }
+
+    const auto stop_at = std::chrono::steady_clock::now();
+    cancelled_source.request_stop();
+    cancelled.join();
+    EXPECT_LT(std::chrono::steady_clock::now() - stop_at, std::chrono::seconds(1));
+    EXPECT_FALSE(cancelled_result.load());
+    EXPECT_EQ(table.idleSmokers(Ingredient::kTobacco), 1u); //    
+
+    EXPECT_TRUE(table.runRound(Ingredient::kPaper, Ingredient::kMatches)); //   
+    colleague.join();
+    EXPECT_TRUE(colleague_result.load());
+
+    std::stop_source already_stopped;
+    already_stopped.request_stop();
+    EXPECT_FALSE(table.startSmoking(Ingredient::kPaper, already_stopped.get_token()));
+    EXPECT_TRUE(table.waitForRoundEnd(already_stopped.get_token())); //   -    
+}
+
+//  32:  -  ,    
+TEST(SharedTableTest, SmokersInChildProcesses) {
+    const std::string name = "/smoking_test_" + std::to_string(getpid());
+    auto table = SharedSmokingTable::Create(name);
+    ASSERT_TRUE(table.has_value());
+    auto second_handle = SharedSmokingTable::Open(name); //      
+    ASSERT_TRUE(second_handle.has_value());
+
+    std::vector<pid_t> children;
+    for (const Ingredient ingredient : kAllSmokers) {
+        const pid_t child = fork();
+        ASSERT_GE(child, 0);
+        if (child == 0) { //      fork,   
+            while (table->startSmoking(ingredient)) {
+                table->finishSmoking();
+            }
+            _exit(0);
+        }
+        children.push_back(child);
+    }
+
+    for (int round = 0; round < 30; ++round) {
+        const auto components = ComponentsFor(kAllSmokers[static_cast<std::size_t>(round) % kSmokerCount]);
+        EXPECT_TRUE(second_handle->runRound(components[0], components[1]));
+    }
+    table->finish();
+    for (const pid_t child : children) {
+        int status = 0;
+        waitpid(child, &status, 0);
+        EXPECT_TRUE(WIFEXITED(status));
+    }
+    EXPECT_EQ(table->completedRounds(), 30u);
+    EXPECT_EQ(table->recoveredRounds(), 0u);
+}
+
+//  33:       -     
+TEST(SharedTableTest, RecoversRoundOfDeadSmoker) {
+    const std::string name = "/smoking_crash_" + std::to_string(getpid());
+    auto table = SharedSmokingTable::Create(name);
+    ASSERT_TRUE(table.has_value());
+
+    const pid_t child = fork();
+    ASSERT_GE(child, 0);
+    if (child == 0) {
+        if (table->startSmoking(Ingredient::kTobacco)) {
+            _exit(0); // "",   finishSmoking()
+        }
+        _exit(1);
+    }
+
+    table->place(Ingredient::kPaper, Ingredient::kMatches);
+    const auto start = std::chrono::steady_clock::now();
+    table->waitForRoundEnd(); //     
+    EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(5));
+    EXPECT_EQ(table->recoveredRounds(), 1u);
+    EXPECT_EQ(table->completedRounds(), 0u);
+    int status = 0;
+    waitpid(child, &status, 0);
+
+    std::thread smoker([&] { //   
+        while (table->startSmoking(Ingredient::kPaper)) {
+            table->finishSmoking();
+        }
+    });
+    EXPECT_TRUE(table->runRound(Ingredient::kTobacco, Ingredient::kMatches));
+    table->finish();
+    smoker.join();
+    EXPECT_EQ(table->completedRounds(), 1u);
+}
 
+//  34:     ,     ,
+//       ,    
+TEST(AgentPolicyTest, IdleAwarePoliciesBeatUniformOnHeterogeneousSmokers) {
+    SimulationConfig config;
+    config.rounds = 20000;
+    config.depth = 6;
+    config.smokers_per_type = 2;
+    config.rolling = DurationDistribution::Constant(std::chrono::milliseconds(50));
+    config.smoking = {DurationDistribution::Exponential(std::chrono::milliseconds(100)),
+                      DurationDistribution::Exponential(std::chrono::milliseconds(300)),
+                      DurationDistribution::Exponential(std::chrono::milliseconds(900))};
 
+    const SimulationResult uniform = RunSimulation(config);
+    for (const auto policy : {AgentPolicy::kLeastRecentlyServed, AgentPolicy::kWeightedDeficit}) {
+        config.policy = policy;
+        const SimulationResult result = RunSimulation(config);
+        EXPECT_EQ(result.rounds, 20000u);
+        EXPECT_GT(result.roundsPerSecond(), 2 * uniform.roundsPerSecond()) << AgentPolicyName(policy);
+        EXPECT_LT(result.latencyPercentile(0.99), uniform.latencyPercentile(0.99)) << AgentPolicyName(policy);
+    }
+
+    //     -     
+    config.policy = AgentPolicy::kRoundRobin;
+    config.depth = 1;
+    config.rounds = 3000;
+    const SimulationResult round_robin = RunSimulation(config);
+    for (std::size_t type = 0; type < kSmokerCount; ++type) {
+        EXPECT_EQ(round_robin.smoked_count[type] + round_robin.smoked_count[type + kSmokerCount], 1000u);
+    }
 
+    EXPECT_EQ(ParseAgentPolicy("deficit"), AgentPolicy::kWeightedDeficit);
+    EXPECT_EQ(ParseAgentPolicy("round-robin"), AgentPolicy::kRoundRobin);
+    EXPECT_FALSE(ParseAgentPolicy("random").has_value());
+}
 
+//  35:  -       ,     ,
+//      JSON     
+TEST(TraceTest, RecordsPerThreadEventsAndConvertsToChromeJson) {
+    std::FILE* file = std::tmpfile();
+    ASSERT_NE(file, nullptr);
+    constexpr int kRounds = 30;
+    {
+        SmokingTable table;
+        TraceRecorder tracer(file, 8); //   8  -     
+        std::thread smoker([&] {
+            for (std::uint32_t cigarette = 1;; ++cigarette) {
+                tracer.begin(TraceEvent::kTake, 0, cigarette);
+                const bool took = table.startSmoking(Ingredient::kTobacco);
+                tracer.end(TraceEvent::kTake, 0, cigarette);
+                if (!took) {
+                    break;
+                }
+                TraceScope scope(tracer, TraceEvent::kFinish, 0, cigarette);
+                table.finishSmoking();
+            }
+        });
+        for (int round = 1; round <= kRounds; ++round) {
+            TraceScope scope(tracer, TraceEvent::kPlace, kTraceAgent, static_cast<std::uint32_t>(round));
+            table.place(Ingredient::kPaper, Ingredient::kMatches);
+        }
+        table.waitForRoundEnd();
+        table.finish();
+        smoker.join();
+    } //    
 
+    std::rewind(file);
+    const auto records = ReadTrace(file);
+    ASSERT_TRUE(records.has_value());
+    ASSERT_EQ(records->size(), static_cast<std::size_t>(2 * kRounds + 4 * kRounds + 2));
 
+    std::array<std::uint64_t, 2> last_ns{};
+    std::array<std::size_t, 2> count{};
+    for (const TraceRecord& record : *records) {
+        ASSERT_LT(record.thread, 2u);
+        EXPECT_GE(record.ns, last_ns[record.thread]); //       
+        last_ns[record.thread] = record.ns;
+        ++count[record.thread];
+    }
+    EXPECT_EQ(count[0] + count[1], records->size());
 
+    std::rewind(file);
+    std::FILE* json = std::tmpfile();
+    ASSERT_NE(json, nullptr);
+    EXPECT_EQ(ConvertTraceToChromeJson(file, json), records->size());
+    std::rewind(json);
+    std::string text;
+    char chunk[4096];
+    std::size_t read = 0;
+    while ((read = std::fread(chunk, 1, sizeof(chunk), json)) > 0) {
+        text.append(chunk, read);
+    }
+    EXPECT_EQ(text.rfind("{\"traceEvents\":[", 0), 0u);
+    std::size_t names = 0;
+    for (std::size_t at = text.find("thread_name"); at != std::string::npos; at = text.find("thread_name", at + 1)) {
+        ++names;
+    }
+    EXPECT_EQ(names, 2u);
+    std::fclose(json);
+    std::fclose(file);
+
+    std::FILE* garbage = std::tmpfile();
+    std::fputs("not a trace", garbage);
+    std::rewind(garbage);
+    EXPECT_FALSE(ReadTrace(garbage).has_value());
+    std::fclose(garbage);
+}
+
+//  36:            
+TEST(ReplayTest, RecordedScheduleReplaysSamePairs) {
+    const std::string path = "/tmp/smoking_replay_" + std::to_string(getpid()) + ".bin";
+    constexpr std::size_t kRounds = 600; //   RoundRecorder -    
+    {
+        std::FILE* file = std::fopen(path.c_str(), "wb");
+        ASSERT_NE(file, nullptr);
+        {
+            RoundRecorder recorder(file);
+            for (std::size_t i = 0; i < kRounds; ++i) {
+                recorder.record(MakeRoundRecord(kAllSmokers[(i * 7) % kSmokerCount], std::chrono::microseconds(i),
+                                                std::chrono::microseconds(i % 5)));
+            }
+        }
+        std::fputs("tail", file); //      
+        std::fclose(file);
+    }
+
+    const auto schedule = ReplaySchedule::Open(path);
+    ASSERT_TRUE(schedule.has_value());
+    ASSERT_EQ(schedule->rounds().size(), kRounds);
+    EXPECT_EQ(schedule->rounds()[1].smoker, IngredientIndex(kAllSmokers[7 % kSmokerCount]));
+    EXPECT_EQ(schedule->rounds()[4].place_ns, 4000u);
+
+    TableUnderTest table;
+    std::array<std::atomic<std::size_t>, kSmokerCount> smoked{};
+    std::vector<std::thread> smokers;
+    for (const Ingredient smoker : kAllSmokers) {
+        smokers.emplace_back([&, smoker] {
+            while (table.startSmoking(smoker)) {
+                smoked[IngredientIndex(smoker)].fetch_add(1);
+                table.finishSmoking();
+            }
+        });
+    }
+    const std::vector<RoundRecord> replayed = ReplayRounds(table, schedule->rounds());
+    table.finish();
+    for (auto& smoker : smokers) {
+        smoker.join();
+    }
 
+    const ReplayComparison comparison = CompareReplays(schedule->rounds(), replayed);
+    EXPECT_EQ(comparison.rounds, kRounds);
+    EXPECT_EQ(comparison.smoker_mismatches, 0u);
+    std::array<std::size_t, kSmokerCount> expected{};
+    for (const RoundRecord& round : schedule->rounds()) {
+        ++expected[round.smoker];
+    }
+    for (std::size_t type = 0; type < kSmokerCount; ++type) {
+        EXPECT_EQ(smoked[type].load(), expected[type]);
+    }
+    std::remove(path.c_str());
+
+    EXPECT_FALSE(ReplaySchedule::Open(path).has_value()); //   
+}
+
+//  37:  -     ,         
+TEST(InventoryTableTest, ProducersAndSmokersNeverShareUnits) {
+    InventoryTable table(4); //   -     capacity
+    constexpr std::uint64_t kRounds = 3000;
+    std::array<std::atomic<std::uint64_t>, kSmokerCount> smoked{};
+    std::array<std::uint64_t, kSmokerCount> supplied{};
+    std::vector<std::thread> smokers;
+    for (std::size_t i = 0; i < 2 * kSmokerCount; ++i) {
+        smokers.emplace_back([&, smoker = kAllSmokers[i % kSmokerCount]] {
+            while (table.startSmoking(smoker)) {
+                smoked[IngredientIndex(smoker)].fetch_add(1);
+                table.finishSmoking();
+                if (table.completedRounds() >= kRounds) {
+                    table.finish();
+                }
+            }
+        });
+    }
+    std::vector<std::thread> producers;
+    for (const Ingredient ingredient : kAllSmokers) {
+        producers.emplace_back([&, ingredient] {
+            while (table.supply(ingredient)) { //  ,    
+                ++supplied[IngredientIndex(ingredient)];
+            }
+        });
+    }
+    for (auto& producer : producers) {
+        producer.join();
+    }
+    for (auto& smoker : smokers) {
+        smoker.join();
+    }
+
+    //        
+    for (const Ingredient ingredient : kAllSmokers) {
+        std::uint64_t used = 0;
+        for (const Ingredient smoker : kAllSmokers) {
+            if (smoker != ingredient) {
+                used += smoked[IngredientIndex(smoker)].load();
+            }
+        }
+        EXPECT_EQ(used + table.available(ingredient), supplied[IngredientIndex(ingredient)]);
+        EXPECT_LE(table.available(ingredient), 4u);
+    }
+    EXPECT_GE(table.completedRounds(), kRounds);
+    EXPECT_EQ(table.completedRounds(), smoked[0].load() + smoked[1].load() + smoked[2].load());
+    EXPECT_FALSE(table.supply(Ingredient::kTobacco)); //  
+}
+
+//  38:  ,     ,    
+TEST(InventoryTableTest, SmokerNeedsBothComponents) {
+    InventoryTable table;
+    EXPECT_TRUE(table.supply(Ingredient::kPaper));
+    EXPECT_FALSE(table.tryStartSmoking(Ingredient::kTobacco)); //   -   
+    EXPECT_EQ(table.available(Ingredient::kPaper), 1u);
+    EXPECT_TRUE(table.supply(Ingredient::kMatches));
+    EXPECT_FALSE(table.tryStartSmoking(Ingredient::kPaper));
+    EXPECT_TRUE(table.tryStartSmoking(Ingredient::kTobacco));
+    EXPECT_EQ(table.available(Ingredient::kPaper), 0u);
+    EXPECT_EQ(table.available(Ingredient::kMatches), 0u);
+    EXPECT_FALSE(table.tryStartSmoking(Ingredient::kTobacco));
+}
+
+//  39:    ,       ,  waitIdle()   
+TEST(WorkStealingPoolTest, RunsNestedTasksToCompletion) {
+    WorkStealingPool pool(4);
+    std::atomic<int> done{0};
+    for (int i = 0; i < 10; ++i) {
+        pool.submit([&] {
+            for (int j = 0; j < 100; ++j) { //    -    ,  
+                pool.submit([&] { done.fetch_add(1); });
+            }
+            done.fetch_add(1);
+        });
+    }
+    pool.waitIdle();
+    EXPECT_EQ(done.load(), 10 * 101);
+    EXPECT_EQ(pool.size(), 4u);
+}
+
+//  40:    -  ,    ,   
+TEST(WorkStealingPoolTest, PooledSmokersLimitConcurrencyByPoolSize) {
+    constexpr int kRounds = 300;
+    SmokingTable table(8);
+    WorkStealingPool pool(2);
+    std::atomic<int> running{0};
+    std::atomic<int> max_running{0};
+    std::atomic<int> smoked{0};
+    {
+        PooledSmokers<SmokingTable> smokers(table, pool, 3, [&](const PooledSmokers<SmokingTable>::Round& round) {
+            const int now = running.fetch_add(1) + 1;
+            int seen = max_running.load();
+            while (now > seen && !max_running.compare_exchange_weak(seen, now)) {
+            }
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+            smoked.fetch_add(1);
+            running.fetch_sub(1);
+            round.done();
+        });
+        for (int round = 0; round < kRounds; ++round) {
+            const auto components = ComponentsFor(kAllSmokers[static_cast<std::size_t>(round) % kSmokerCount]);
+            table.place(components[0], components[1]);
+        }
+        table.waitForRoundEnd();
+        table.finish();
+        smokers.join();
+        std::uint64_t started = 0;
+        for (const Ingredient smoker : kAllSmokers) {
+            EXPECT_EQ(smokers.started(smoker), static_cast<std::uint64_t>(kRounds / 3));
+            started += smokers.started(smoker);
+        }
+        EXPECT_EQ(started, static_cast<std::uint64_t>(kRounds));
+    }
+    EXPECT_EQ(smoked.load(), kRounds);
+    EXPECT_LE(max_running.load(), 2);
+}
+
+//    :   rounds   ,     ,
+//  smokers_per_type    ,   
+// :        ,    depth , finish() 
+ExploreScenario TableExploreScenario(std::size_t depth, int rounds, std::size_t smokers_per_type) {
+    struct State {
+        explicit State(std::size_t depth) : table(depth) {}
+        ExploredSmokingTable table;
+        std::array<int, kSmokerCount> placed{};
+        std::array<int, kSmokerCount> taken{};
+        std::size_t busy = 0;
+        std::size_t max_busy = 0;
+        bool finished = false;
+    };
+    auto state = std::make_shared<State>(depth);
+    ExploreScenario scenario;
+    scenario.actors.push_back([state, rounds] {
+        for (int round = 0; round < rounds; ++round) {
+            const Ingredient smoker = kAllSmokers[static_cast<std::size_t>(round) * 2 % kSmokerCount];
+            const auto components = ComponentsFor(smoker);
+            state->table.place(components[0], components[1]);
+            ++state->placed[IngredientIndex(smoker)];
+        }
+        state->table.waitForRoundEnd();
+        state->table.finish();
+        state->finished = true;
+    });
+    for (std::size_t i = 0; i < kSmokerCount * smokers_per_type; ++i) {
+        const Ingredient smoker = kAllSmokers[i % kSmokerCount];
+        scenario.actors.push_back([state, smoker] {
+            while (state->table.startSmoking(smoker)) {
+                ++state->taken[IngredientIndex(smoker)];
+                state->max_busy = std::max(state->max_busy, ++state->busy);
+                ScheduleExplorer::Point(); // :   ,   
+                --state->busy;
+                state->table.finishSmoking();
+            }
+        });
+    }
+    scenario.check = [state, depth] {
+        return state->finished && state->taken == state->placed && state->max_busy <= depth;
+    };
+    return scenario;
+}
+
+//  41:     -       ,   sleep_for
+TEST(ScheduleExploreTest, TableKeepsInvariantsUnderAllSchedules) {
+    for (const std::size_t depth : {std::size_t{1}, std::size_t{2}}) {
+        const ExploreReport random = ExploreRandom([depth] { return TableExploreScenario(depth, 4, 2); }, 3000, depth);
+        EXPECT_EQ(random.schedules, 3000u);
+        EXPECT_EQ(random.failures, 0u) << " " << depth;
+
+        const ExploreReport all = ExploreAll([depth] { return TableExploreScenario(depth, 2, 1); }, 200000);
+        EXPECT_TRUE(all.exhausted);
+        EXPECT_GT(all.schedules, 1000u);
+        EXPECT_EQ(all.failures, 0u) << " " << depth;
+    }
+}
+
+//  42:     ,    
+//   :    ,    
+TEST(ScheduleExploreTest, FindsAndReplaysLostWakeup) {
+    struct Latch {
+        std::mutex mutex;
+        std::condition_variable cv;
+        bool open = false;
+    };
+    auto make = [] {
+        auto latch = std::make_shared<Latch>();
+        ExploreScenario scenario;
+        scenario.actors.push_back([latch] {
+            std::unique_lock<std::mutex> lock(latch->mutex);
+            const bool seen = latch->open;
+            lock.unlock();
+            ScheduleExplorer::Point();
+            lock.lock();
+            if (!seen) {
+                ExploreWait::pause(latch->cv, lock, 0);
+            }
+        });
+        scenario.actors.push_back([latch] {
+            ScheduleExplorer::Point();
+            {
+                std::lock_guard<std::mutex> lock(latch->mutex);
+                latch->open = true;
+            }
+            ExploreWait::notifyAll(latch->cv);
+        });
+        return scenario;
+    };
+    const ExploreReport all = ExploreAll(make, 1000);
+    EXPECT_TRUE(all.exhausted);
+    ASSERT_GT(all.failures, 0u);
+    ASSERT_TRUE(all.first_failure.has_value());
+    EXPECT_EQ(all.first_failure->outcome, ScheduleExplorer::Run::Outcome::kDeadlock);
+
+    const ExploreReport replay = ReplayExplored(make, *all.first_failure);
+    EXPECT_EQ(replay.failures, 1u);
+}
+
+//  43:   -     ,      
+TEST(ElasticSmokersTest, LastSmokerOfTypeDrainsItsPairsBeforeLeaving) {
+    SmokingTable table(3);
+    table.joinSmoker(Ingredient::kTobacco);
+    table.joinSmoker(Ingredient::kTobacco);
+    table.joinSmoker(Ingredient::kPaper);
+    EXPECT_EQ(table.registeredSmokers(Ingredient::kTobacco), 2u);
+
+    std::stop_source leaving;
+    leaving.request_stop();
+    //    ,  :     -   
+    const auto for_paper = ComponentsFor(Ingredient::kPaper);
+    const auto for_tobacco = ComponentsFor(Ingredient::kTobacco);
+    table.place(for_paper[0], for_paper[1]);
+    table.place(for_tobacco[0], for_tobacco[1]);
+    EXPECT_FALSE(table.startSmokingOrLeave(Ingredient::kTobacco, leaving.get_token()));
+    EXPECT_EQ(table.registeredSmokers(Ingredient::kTobacco), 1u);
+
+    //     stop     ,     
+    EXPECT_TRUE(table.startSmokingOrLeave(Ingredient::kPaper, leaving.get_token()));
+    table.finishSmoking();
+    //    :    
+    EXPECT_TRUE(table.startSmokingOrLeave(Ingredient::kTobacco, leaving.get_token()));
+    table.finishSmoking();
+    EXPECT_FALSE(table.startSmokingOrLeave(Ingredient::kPaper, leaving.get_token()));
+    EXPECT_FALSE(table.startSmokingOrLeave(Ingredient::kTobacco, leaving.get_token()));
+    EXPECT_EQ(table.registeredSmokers(Ingredient::kPaper), 0u);
+    EXPECT_EQ(table.registeredSmokers(Ingredient::kTobacco), 0u);
+    EXPECT_TRUE(table.waitForRoundEndFor(std::chrono::seconds(5)));
+}
+
+//  44:       -        
+TEST(ElasticSmokersTest, JoinAndLeaveWhileAgentPlacesUnderExploredSchedules) {
+    constexpr int kRounds = 6;
+    auto make = [] {
+        struct State {
+            ExploredSmokingTable table{2};
+            std::array<int, kSmokerCount> placed{};
+            std::array<int, kSmokerCount> taken{};
+            std::array<std::stop_source, 2> extra{}; //     
+            bool finished = false;
+        };
+        auto state = std::make_shared<State>();
+        ExploreScenario scenario;
+        scenario.actors.push_back([state] {
+            for (int round = 0; round < kRounds; ++round) {
+                const Ingredient smoker = kAllSmokers[static_cast<std::size_t>(round) % kSmokerCount];
+                const auto components = ComponentsFor(smoker);
+                if (state->table.place(components[0], components[1])) {
+                    ++state->placed[IngredientIndex(smoker)];
+                }
+            }
+            state->table.waitForRoundEnd();
+            state->table.finish();
+            state->finished = true;
+        });
+        auto smoke = [state](Ingredient smoker, std::stop_token stop, bool join) {
+            if (join) {
+                state->table.joinSmoker(smoker);
+            }
+            while (state->table.startSmokingOrLeave(smoker, stop)) {
+                ++state->taken[IngredientIndex(smoker)];
+                ScheduleExplorer::Point();
+                state->table.finishSmoking();
+            }
+        };
+        for (const Ingredient smoker : kAllSmokers) { // :   ,    finish()
+            state->table.table().joinSmoker(smoker);
+            scenario.actors.push_back([smoke, smoker] { smoke(smoker, {}, false); });
+        }
+        for (std::size_t i = 0; i < state->extra.size(); ++i) {
+            scenario.actors.push_back([smoke, state, i] { smoke(kAllSmokers[i], state->extra[i].get_token(), true); });
+        }
+        scenario.actors.push_back([state] { //   -  
+            for (auto& extra : state->extra) {
+                ScheduleExplorer::Point();
+                extra.request_stop();
+            }
+        });
+        scenario.check = [state] {
+            bool everyone_left = true;
+            for (const Ingredient smoker : kAllSmokers) {
+                everyone_left = everyone_left && state->table.table().registeredSmokers(smoker) == 0;
+            }
+            return state->finished && state->taken == state->placed && everyone_left;
+        };
+        return scenario;
+    };
+    const ExploreReport random = ExploreRandom(make, 3000, 7);
+    EXPECT_EQ(random.failures, 0u);
+    const ExploreReport all = ExploreAll(make, 100000, 1);
+    EXPECT_EQ(all.failures, 0u);
+    EXPECT_GT(all.schedules, 1000u);
+}
+
+//  45: finish()   -     finishSmoking(),   
+TEST_F(SmokingTableTest, FinishWhileSmokingThenFinishSmoking) {
+    table->place(Ingredient::kPaper, Ingredient::kMatches);
+    ASSERT_TRUE(table->startSmoking(Ingredient::kTobacco)); //     -  
+    table->finish();
+    table->finishSmoking(); //      
+    EXPECT_FALSE(table->startSmoking(Ingredient::kTobacco));
+    table->waitForRoundEnd(); //   -  
+
+    CoroExecutor executor(1);
+    AsyncSmokingTable coro_table(executor);
+    std::atomic<int> smoked{0};
+    std::atomic<int> after_finish{0};
+    auto smoker = [](AsyncSmokingTable& table, std::atomic<int>& smoked,
+                     std::atomic<int>& after_finish) -> CoroExecutor::Task {
+        const bool took = co_await table.startSmoking(Ingredient::kTobacco);
+        if (took) {
+            smoked.fetch_add(1);
+            table.finish(); //  ,    
+            table.finishSmoking();
+            const bool again = co_await table.startSmoking(Ingredient::kTobacco);
+            after_finish.fetch_add(again ? 1 : 0);
+        }
+    };
+    executor.spawn(smoker(coro_table, smoked, after_finish));
+    executor.spawn(PipelinedAgent(coro_table, 1));
+    executor.waitIdle();
+    EXPECT_EQ(smoked.load(), 1);
+    EXPECT_EQ(after_finish.load(), 0);
+}
+
+//  46:      -     ,    
+TEST_F(SmokingTableTest, DegeneratePairIsRejected) {
+    EXPECT_FALSE(table->place(Ingredient::kPaper, Ingredient::kPaper));
+    EXPECT_FALSE(table->runRound(Ingredient::kMatches, Ingredient::kMatches));
+    std::thread smoker([this] {
+        if (table->startSmoking(Ingredient::kTobacco)) {
+            table->finishSmoking();
+        }
+    });
+    EXPECT_TRUE(table->runRound(Ingredient::kPaper, Ingredient::kMatches)); //   
+    smoker.join();
+
+    SmokingTable pipelined(2);
+    EXPECT_FALSE(pipelined.tryPlace(IngredientBit(Ingredient::kTobacco)));
+    EXPECT_FALSE(pipelined.place(kFullMask<kSmokerCount>)); //   -   
+    EXPECT_EQ(pipelined.runRounds(std::span<const IngredientMask>()), 0u);
+
+    const std::string name = "/smoking_test_pair_" + std::to_string(getpid());
+    auto shared = SharedSmokingTable::Create(name);
+    ASSERT_TRUE(shared.has_value());
+    EXPECT_FALSE(shared->place(Ingredient::kTobacco, Ingredient::kTobacco));
+
+    CoroExecutor executor(1);
+    AsyncSmokingTable coro_table(executor);
+    std::atomic<int> placed{-1};
+    auto agent = [](AsyncSmokingTable& table, std::atomic<int>& placed) -> CoroExecutor::Task {
+        const bool ok = co_await table.place(Ingredient::kPaper, Ingredient::kPaper);
+        placed.store(ok ? 1 : 0);
+    };
+    executor.spawn(agent(coro_table, placed));
+    executor.waitIdle();
+    EXPECT_EQ(placed.load(), 0);
+}
+
+//  47:       -      
+TEST(AgentPolicyTest, TableCountsPendingPairsPerType) {
+    SmokingTable table(3);
+    EXPECT_TRUE(table.place(Ingredient::kPaper, Ingredient::kMatches));
+    EXPECT_TRUE(table.place(Ingredient::kPaper, Ingredient::kMatches));
+    EXPECT_TRUE(table.place(Ingredient::kTobacco, Ingredient::kMatches));
+    EXPECT_EQ(table.pendingFor(Ingredient::kTobacco), 2u);
+    EXPECT_EQ(table.pendingFor(Ingredient::kPaper), 1u);
+    EXPECT_EQ(table.pendingFor(Ingredient::kMatches), 0u);
+    const auto counts = table.smokerCounts(); //    
+    EXPECT_EQ(counts.pending[IngredientIndex(Ingredient::kTobacco)], 2u);
+    EXPECT_EQ(counts.pending[IngredientIndex(Ingredient::kPaper)], 1u);
+    EXPECT_EQ(counts.free(IngredientIndex(Ingredient::kTobacco)), 0u); //   -   
+    EXPECT_FALSE(AgentPicker(AgentPolicy::kUniform).usesView());
+    EXPECT_TRUE(AgentPicker(AgentPolicy::kWeightedDeficit).usesView());
+
+    EXPECT_TRUE(table.tryStartSmoking(Ingredient::kTobacco)); //    
+    EXPECT_EQ(table.pendingFor(Ingredient::kTobacco), 1u);
+    table.finish(); //   
+    EXPECT_EQ(table.pendingFor(Ingredient::kTobacco), 0u);
+    EXPECT_EQ(table.pendingFor(Ingredient::kPaper), 0u);
+    table.finishSmoking();
+}
+
+//  48:    ,      , -
+// place()  ,     ;    -   
+TEST(ElasticSmokersTest, PlaceRejectsPairForTypeThatJustLeft) {
+    auto make = [] {
+        struct State {
+            ExploredSmokingTable table{2};
+            std::stop_source leaving{};
+            int placed = 0;
+            int taken = 0;
+            bool finished = false;
+        };
+        auto state = std::make_shared<State>();
+        state->table.table().joinSmoker(Ingredient::kTobacco);
+        state->table.table().joinSmoker(Ingredient::kPaper);
+        ExploreScenario scenario;
+        scenario.actors.push_back([state] {
+            const auto for_tobacco = ComponentsFor(Ingredient::kTobacco);
+            const auto for_paper = ComponentsFor(Ingredient::kPaper);
+            for (int round = 0; round < 2; ++round) {
+                if (state->table.table().registeredSmokers(Ingredient::kTobacco) > 0 && //   ...
+                    state->table.place(for_tobacco[0], for_tobacco[1])) {              // ...    
+                    ++state->placed;
+                }
+            }
+            EXPECT_TRUE(state->table.place(for_paper[0], for_paper[1])); //       
+            ++state->placed;
+            state->table.waitForRoundEnd();
+            state->table.finish();
+            state->finished = true;
+        });
+        for (const Ingredient smoker : {Ingredient::kTobacco, Ingredient::kPaper}) {
+            scenario.actors.push_back([state, smoker] {
+                const std::stop_token stop = smoker == Ingredient::kTobacco ? state->leaving.get_token() : std::stop_token{};
+                while (state->table.startSmokingOrLeave(smoker, stop)) {
+                    ++state->taken;
+                    state->table.finishSmoking();
+                }
+            });
+        }
+        scenario.actors.push_back([state] {
+            ScheduleExplorer::Point();
+            state->leaving.request_stop();
+        });
+        scenario.check = [state] {
+            return state->finished && state->taken == state->placed;
+        };
+        return scenario;
+    };
+    const ExploreReport all = ExploreAll(make, 100000, 2);
+    EXPECT_EQ(all.failures, 0u);
+    EXPECT_GT(all.schedules, 100u);
+}
+
+//  49:     -   Create()  ,     ,
+//   ,       ,       pid
+TEST(SharedTableTest, TicketsIdentifySmokersAndCreateKeepsExistingSegment) {
+    const std::string name = "/smoking_ticket_" + std::to_string(getpid());
+    auto table = SharedSmokingTable::Create(name);
+    ASSERT_TRUE(table.has_value());
+    EXPECT_FALSE(SharedSmokingTable::Create(name).has_value()); //   -    
+
+    ASSERT_TRUE(table->place(Ingredient::kPaper, Ingredient::kMatches));
+    ASSERT_TRUE(table->startSmoking(Ingredient::kTobacco)); //    
+    std::thread other([&] { table->finishSmoking(); }); //    ,    
+    other.join();
+    EXPECT_EQ(table->completedRounds(), 0u);
+    table->finishSmoking();
+    EXPECT_EQ(table->completedRounds(), 1u);
+    table->waitForRoundEnd();
+
+    const std::uint64_t started = shm_detail::SelfStartTime();
+    EXPECT_TRUE(shm_detail::ProcessAlive(getpid(), started));
+    if (started != 0) { //  /proc:   pid     -   
+        EXPECT_FALSE(shm_detail::ProcessAlive(getpid(), started + 1));
+    }
+    table->finish();
+
+    EXPECT_TRUE(SharedSmokingTable::Remove(name)); //  :    
+    auto again = SharedSmokingTable::Create(name);
+    EXPECT_TRUE(again.has_value());
+}
+
+//  50:     -  :       ,
+//    -       
+TEST(WorkStealingPoolTest, TimedContinuationsReleasePoolThreads) {
+    constexpr int kRounds = 24;
+    constexpr std::size_t kSeats = 2;
+    SmokingTable table(kSeats * kSmokerCount);
+    WorkStealingPool pool(1);
+    std::atomic<int> in_flight{0};
+    std::atomic<int> max_in_flight{0};
+    std::array<std::atomic<int>, kSeats * kSmokerCount> per_seat{};
+    std::atomic<bool> seat_in_range{true};
+    {
+        PooledSmokers<SmokingTable> smokers(table, pool, kSeats, [&](const PooledSmokers<SmokingTable>::Round& round) {
+            seat_in_range = seat_in_range && round.seat < kSeats && round.waited.count() >= 0 && round.number >= 1;
+            ++per_seat[round.seat * kSmokerCount + IngredientIndex(round.smoker)];
+            const int now = in_flight.fetch_add(1) + 1;
+            int seen = max_in_flight.load();
+            while (now > seen && !max_in_flight.compare_exchange_weak(seen, now)) {
+            }
+            pool.submitAfter(std::chrono::milliseconds(20), [&in_flight, round] { // ""  
+                in_flight.fetch_sub(1);
+                round.done();
+            });
+        });
+        for (int round = 0; round < kRounds; ++round) {
+            const auto components = ComponentsFor(kAllSmokers[static_cast<std::size_t>(round) % kSmokerCount]);
+            table.place(components[0], components[1]);
+        }
+        table.waitForRoundEnd();
+        table.finish();
+        smokers.join();
+    }
+    EXPECT_TRUE(seat_in_range.load());
+    EXPECT_GT(max_in_flight.load(), 1); //   ,      
+    EXPECT_LE(max_in_flight.load(), static_cast<int>(kSeats * kSmokerCount));
+    int total = 0;
+    for (const auto& count : per_seat) {
+        total += count.load();
+    }
+    EXPECT_EQ(total, kRounds);
+}
+
+//  51:     ,      
+//  ;       
+TEST(ReplayTest, SmokerTimingsMergeAndEmptyRecordingIsRejected) {
+    SmokingTable table(3);
+    const std::array<Ingredient, 3> order = {kAllSmokers[2], kAllSmokers[0], kAllSmokers[1]};
+    std::vector<RoundRecord> rounds;
+    for (const Ingredient smoker : order) {
+        const auto components = ComponentsFor(smoker);
+        ASSERT_TRUE(table.place(components[0], components[1]));
+        rounds.push_back(MakeRoundRecord(smoker, std::chrono::nanoseconds(0), std::chrono::nanoseconds(0)));
+    }
+    std::vector<RoundTiming> timings;
+    for (std::uint64_t round = 1; round <= order.size(); ++round) {
+        EXPECT_EQ(table.startSmokingRound(order[round - 1]), round); //     
+        table.finishSmoking();
+        timings.push_back({round, std::chrono::microseconds(10 * round)});
+    }
+    timings.push_back({7, std::chrono::microseconds(1)}); //      - 
+    MergeRoundTimings(rounds, timings);
+    EXPECT_EQ(rounds[0].smoke_ns, 10000u);
+    EXPECT_EQ(rounds[2].smoke_ns, 30000u);
+    table.finish();
+    EXPECT_EQ(table.startSmokingRound(order[0]), 0u);
+
+    std::vector<RoundRecord> candidate = rounds;
+    candidate[1].smoke_ns += 5000;
+    candidate[2].smoke_ns = 0; //   -    
+    const ReplayComparison comparison = CompareReplays(rounds, candidate);
+    EXPECT_EQ(comparison.smoked_rounds, 2u);
+    EXPECT_EQ(comparison.candidate_smoke_total - comparison.baseline_smoke_total, std::chrono::microseconds(5));
+    EXPECT_EQ(comparison.max_smoke_slowdown, std::chrono::microseconds(5));
+    EXPECT_EQ(comparison.slowest_smoke_round, 1u);
+
+    const std::string path = "/tmp/smoking_replay_empty_" + std::to_string(getpid()) + ".bin";
+    for (const char* tail : {"", "short"}) { //  ;    
+        std::FILE* file = std::fopen(path.c_str(), "wb");
+        ASSERT_NE(file, nullptr);
+        { RoundRecorder recorder(file); }
+        std::fputs(tail, file);
+        std::fclose(file);
+        EXPECT_FALSE(ReplaySchedule::Open(path).has_value()) << ": \"" << tail << "\"";
+    }
+    std::remove(path.c_str());
+}
+
+//  52: Open()    ,  Create()      
+// ( shm_open()  ftruncate())     magic, -       SIGBUS
+TEST(SharedTableTest, OpenRejectsSegmentStillBeingCreated) {
+    const std::string name = "/smoking_half_" + std::to_string(getpid());
+    const int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    ASSERT_GE(fd, 0);
+    EXPECT_FALSE(SharedSmokingTable::Open(name).has_value()); //   
+    ASSERT_EQ(ftruncate(fd, 1 << 16), 0);                    //  ,  magic  
+    EXPECT_FALSE(SharedSmokingTable::Open(name).has_value());
+    close(fd);
+    EXPECT_TRUE(SharedSmokingTable::Remove(name));
+
+    auto table = SharedSmokingTable::Create(name);
+    ASSERT_TRUE(table.has_value());
+    EXPECT_TRUE(SharedSmokingTable::Open(name).has_value());
+}
@@ -0,0 +1,34 @@
+#include <cstdio>
+
+#include "smoking_trace.hpp"
+
+// перевод двоичной трассы (app --trace=ФАЙЛ) в JSON для chrome://tracing и ui.perfetto.dev
+// trace2json ТРАССА [ВЫХОД.json]; без второго аргумента JSON печатается в stdout
+int main(int argc, char** argv) {
+  if (argc < 2 || argc > 3) {
+    std::fprintf(stderr, "использование: %s ТРАССА [ВЫХОД.json]\n", argv[0]);
+    return 1;
+  }
+  std::FILE* in = std::fopen(argv[1], "rb");
+  if (in == nullptr) {
+    std::fprintf(stderr, "не удалось открыть %s\n", argv[1]);
+    return 1;
+  }
+  std::FILE* out = argc == 3 ? std::fopen(argv[2], "w") : stdout;
+  if (out == nullptr) {
+    std::fprintf(stderr, "не удалось открыть %s\n", argv[2]);
+    std::fclose(in);
+    return 1;
+  }
+  const auto events = ConvertTraceToChromeJson(in, out);
+  std::fclose(in);
+  if (out != stdout) {
+    std::fclose(out);
+  }
+  if (!events) {
+    std::fprintf(stderr, "%s - не трасса или другая версия формата\n", argv[1]);
+    return 1;
+  }
+  std::fprintf(stderr, "событий: %zu\n", *events);
+  return 0;
+}